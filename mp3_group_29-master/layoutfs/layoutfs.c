@@ -0,0 +1,364 @@
+/*
+ * layoutfs - builds filesys_img from a directory, like createfs, but
+ * lays the image out for the kernel's read path:
+ *
+ *   - dentries are sorted by name, so lookups can binary search
+ *   - each file's data blocks are contiguous and in file order, so
+ *     read_data copies a whole file in one extent
+ *   - files are stored in dentry order, back to back
+ *
+ * The format is the one in Appendix A of the MP3 writeup, so the kernel
+ * reads these images unchanged. Data blocks are 4KB and start on a 4KB
+ * boundary of the image, so as long as the image is loaded page aligned
+ * every block can already be mapped straight into a process.
+ *
+ * With -z, files other than executables are LZ compressed when that
+ * saves at least a block (see student-distrib/lz.h). Each 4KB of the
+ * file is compressed on its own, after a table of nchunks + 1 offsets
+ * into the stored data; a chunk that doesn't shrink is stored as is.
+ * The inode keeps the uncompressed length and the dentry is flagged
+ * DENTRY_COMPRESSED. Executables stay plain so they can be mapped.
+ *
+ * usage: layoutfs -i fsdir -o filesys_img [-n inodes] [-z]
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BLOCK_SIZE          4096
+#define MAX_NAME_LENGTH     32
+#define MAX_DENTRIES        63
+#define MAX_FILE_BLOCKS     (BLOCK_SIZE / 4 - 1)
+#define DEFAULT_INODES      64
+
+// LZ format, as in student-distrib/lz.h
+#define LZ_WINDOW           4096
+#define LZ_MIN_MATCH        3
+#define LZ_MAX_MATCH        (LZ_MIN_MATCH + 15)
+#define LZ_HASH_SIZE        4096
+
+#define DENTRY_COMPRESSED   0x1
+
+// dentry file types
+#define RTC_ACCESS          0
+#define DIRECTORY_ACCESS    1
+#define FILE_ACCESS         2
+
+typedef struct entry {
+    char name[MAX_NAME_LENGTH + 1];
+    uint32_t type;
+    uint32_t inode;
+    uint32_t length;
+    uint32_t first_block;
+    char* path;
+    uint8_t* data;          // what goes in the data blocks
+    uint32_t stored;        // its size
+    uint8_t flags;          // DENTRY_* flags
+} entry_t;
+
+static entry_t entries[MAX_DENTRIES];
+static int num_entries;
+
+/*
+ * DESCRIPTION: Orders dentries by name the way the kernel compares them
+ * (strncmp over MAX_NAME_LENGTH bytes).
+ */
+static int entry_cmp(const void* a, const void* b)
+{
+    return strncmp(((const entry_t*)a)->name, ((const entry_t*)b)->name, MAX_NAME_LENGTH);
+}
+
+/*
+ * DESCRIPTION: Adds a dentry to the image.
+ *
+ * INPUTS: name -- file name (truncated to MAX_NAME_LENGTH), type -- file
+ * type, path -- host file to copy in, NULL for "." and rtc
+ *
+ * OUTPUTS: 0 on success, -1 if the directory is full
+ */
+static int add_entry(const char* name, uint32_t type, char* path)
+{
+    int i;
+
+    if (num_entries == MAX_DENTRIES) {
+        fprintf(stderr, "layoutfs: too many files, dropping %s\n", name);
+        return -1;
+    }
+
+    for (i = 0; i < num_entries; i++) {
+        if (strncmp(entries[i].name, name, MAX_NAME_LENGTH) == 0) {
+            fprintf(stderr, "layoutfs: %s clashes with %s after truncation, dropping it\n",
+                    name, entries[i].name);
+            return -1;
+        }
+    }
+
+    strncpy(entries[num_entries].name, name, MAX_NAME_LENGTH);
+    entries[num_entries].type = type;
+    entries[num_entries].path = path;
+    num_entries++;
+    return 0;
+}
+
+/*
+ * DESCRIPTION: Writes a little endian 32 bit value into the image.
+ */
+static void put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/*
+ * DESCRIPTION: Greedy LZSS compression of one chunk, matches found
+ * through hash chains on the next LZ_MIN_MATCH bytes. Matches stay
+ * inside the chunk so the kernel can decode any chunk alone.
+ *
+ * INPUTS: src -- chunk, len -- its length (at most LZ_WINDOW), dst --
+ * output, room for len + len / 8 + 1 bytes
+ *
+ * OUTPUTS: compressed length
+ */
+static uint32_t lz_compress(const uint8_t* src, uint32_t len, uint8_t* dst)
+{
+    static int head[LZ_HASH_SIZE];
+    static int prev[LZ_WINDOW];
+    uint32_t in = 0, out = 0, control = 0, bit = 8;
+    uint32_t h, best, best_dist, n, j;
+    int cand;
+
+    for (h = 0; h < LZ_HASH_SIZE; h++) head[h] = -1;
+
+    while (in < len) {
+        if (bit == 8) {
+            control = out++;
+            dst[control] = 0;
+            bit = 0;
+        }
+
+        best = 0;
+        best_dist = 0;
+        h = 0;
+        if (in + LZ_MIN_MATCH <= len) {
+            h = ((src[in] << 8) ^ (src[in + 1] << 4) ^ src[in + 2]) % LZ_HASH_SIZE;
+            for (cand = head[h]; cand >= 0 && best < LZ_MAX_MATCH; cand = prev[cand]) {
+                for (n = 0; n < LZ_MAX_MATCH && in + n < len && src[cand + n] == src[in + n]; n++);
+                if (n > best) {
+                    best = n;
+                    best_dist = in - cand;
+                }
+            }
+        }
+
+        if (best < LZ_MIN_MATCH) {
+            dst[control] |= 1 << bit;
+            dst[out++] = src[in];
+            best = 1;
+        }
+        else {
+            dst[out++] = (best_dist - 1) & 0xFF;
+            dst[out++] = (((best_dist - 1) >> 8) << 4) | (best - LZ_MIN_MATCH);
+        }
+        bit++;
+
+        // every position covered goes in the chains
+        for (j = 0; j < best; j++, in++) {
+            if (in + LZ_MIN_MATCH > len) continue;
+            h = ((src[in] << 8) ^ (src[in + 1] << 4) ^ src[in + 2]) % LZ_HASH_SIZE;
+            prev[in] = head[h];
+            head[h] = in;
+        }
+    }
+
+    return out;
+}
+
+/*
+ * DESCRIPTION: Replaces a file's data with its compressed form if that
+ * takes fewer blocks.
+ *
+ * INPUTS: e -- file, with data and stored set to its contents
+ *
+ * OUTPUTS: none
+ */
+static void compress_entry(entry_t* e)
+{
+    uint32_t chunks = (e->length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32_t table = (chunks + 1) * 4;
+    uint32_t i, len, size, pos;
+    uint8_t chunk[BLOCK_SIZE + BLOCK_SIZE / 8 + 1];
+    uint8_t* out;
+
+    if ((out = malloc(table + chunks * BLOCK_SIZE)) == NULL) return;
+
+    pos = table;
+    for (i = 0; i < chunks; i++) {
+        len = e->length - i * BLOCK_SIZE;
+        if (len > BLOCK_SIZE) len = BLOCK_SIZE;
+
+        size = lz_compress(&e->data[i * BLOCK_SIZE], len, chunk);
+        if (size < len) memcpy(&out[pos], chunk, size);
+        else {
+            // stored raw -- the kernel knows by the size
+            size = len;
+            memcpy(&out[pos], &e->data[i * BLOCK_SIZE], len);
+        }
+
+        put32(&out[4 * i], pos);
+        pos += size;
+    }
+    put32(&out[4 * chunks], pos);
+
+    if ((pos + BLOCK_SIZE - 1) / BLOCK_SIZE >= chunks) {
+        free(out);
+        return;
+    }
+
+    free(e->data);
+    e->data = out;
+    e->stored = pos;
+    e->flags |= DENTRY_COMPRESSED;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* in_dir = NULL;
+    const char* out_file = NULL;
+    uint32_t num_inodes = DEFAULT_INODES;
+    uint32_t num_files = 0, num_blocks = 0, blocks, i, b;
+    DIR* dir;
+    struct dirent* de;
+    struct stat st;
+    uint8_t* image;
+    size_t image_size;
+    FILE* f;
+    char* path;
+    int opt, compress = 0;
+
+    while ((opt = getopt(argc, argv, "i:o:n:z")) != -1) {
+        switch (opt) {
+        case 'i': in_dir = optarg; break;
+        case 'o': out_file = optarg; break;
+        case 'n': num_inodes = strtoul(optarg, NULL, 0); break;
+        case 'z': compress = 1; break;
+        default:
+            fprintf(stderr, "usage: %s -i fsdir -o filesys_img [-n inodes] [-z]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (in_dir == NULL || out_file == NULL) {
+        fprintf(stderr, "usage: %s -i fsdir -o filesys_img [-n inodes] [-z]\n", argv[0]);
+        return 1;
+    }
+
+    if ((dir = opendir(in_dir)) == NULL) {
+        fprintf(stderr, "layoutfs: %s: %s\n", in_dir, strerror(errno));
+        return 1;
+    }
+
+    add_entry(".", DIRECTORY_ACCESS, NULL);
+    add_entry("rtc", RTC_ACCESS, NULL);
+
+    while ((de = readdir(dir)) != NULL) {
+        if (de->d_name[0] == '.') continue;
+
+        path = malloc(strlen(in_dir) + strlen(de->d_name) + 2);
+        sprintf(path, "%s/%s", in_dir, de->d_name);
+
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            free(path);
+            continue;
+        }
+
+        if (add_entry(de->d_name, FILE_ACCESS, path) != 0) free(path);
+    }
+    closedir(dir);
+
+    qsort(entries, num_entries, sizeof(entry_t), entry_cmp);
+
+    // files get inodes and data blocks in dentry order
+    for (i = 0; i < (uint32_t)num_entries; i++) {
+        if (entries[i].type != FILE_ACCESS) continue;
+
+        stat(entries[i].path, &st);
+        blocks = (st.st_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        if (blocks > MAX_FILE_BLOCKS) {
+            fprintf(stderr, "layoutfs: %s is too large\n", entries[i].path);
+            return 1;
+        }
+
+        entries[i].length = st.st_size;
+        entries[i].stored = st.st_size;
+        entries[i].data = malloc(st.st_size + 1);
+
+        if (entries[i].data == NULL || (f = fopen(entries[i].path, "rb")) == NULL ||
+            fread(entries[i].data, 1, entries[i].length, f) != entries[i].length) {
+            fprintf(stderr, "layoutfs: can't read %s\n", entries[i].path);
+            return 1;
+        }
+        fclose(f);
+
+        // executables are mapped block by block, so they stay plain
+        if (compress && !(entries[i].length >= 4 && memcmp(entries[i].data, "\177ELF", 4) == 0)) {
+            compress_entry(&entries[i]);
+            blocks = (entries[i].stored + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        }
+
+        entries[i].inode = num_files++;
+        entries[i].first_block = num_blocks;
+        num_blocks += blocks;
+    }
+
+    if (num_files > num_inodes) num_inodes = num_files;
+
+    image_size = (size_t)(1 + num_inodes + num_blocks) * BLOCK_SIZE;
+    if ((image = calloc(1, image_size)) == NULL) {
+        fprintf(stderr, "layoutfs: out of memory\n");
+        return 1;
+    }
+
+    // boot block
+    put32(&image[0], num_entries);
+    put32(&image[4], num_inodes);
+    put32(&image[8], num_blocks);
+
+    for (i = 0; i < (uint32_t)num_entries; i++) {
+        uint8_t* d = &image[64 * (i + 1)];
+
+        memcpy(d, entries[i].name, strnlen(entries[i].name, MAX_NAME_LENGTH));
+        put32(&d[MAX_NAME_LENGTH], entries[i].type);
+        put32(&d[MAX_NAME_LENGTH + 4], entries[i].inode);
+        d[MAX_NAME_LENGTH + 8] = entries[i].flags;
+
+        if (entries[i].type != FILE_ACCESS) continue;
+
+        // inode, then the file's blocks
+        uint8_t* inode = &image[BLOCK_SIZE * (1 + entries[i].inode)];
+        uint8_t* data = &image[BLOCK_SIZE * (1 + num_inodes + entries[i].first_block)];
+
+        blocks = (entries[i].stored + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        put32(&inode[0], entries[i].length);
+        for (b = 0; b < blocks; b++) put32(&inode[4 * (b + 1)], entries[i].first_block + b);
+
+        memcpy(data, entries[i].data, entries[i].stored);
+    }
+
+    if ((f = fopen(out_file, "wb")) == NULL ||
+        fwrite(image, 1, image_size, f) != image_size) {
+        fprintf(stderr, "layoutfs: can't write %s\n", out_file);
+        return 1;
+    }
+    fclose(f);
+
+    printf("%s: %d dentries, %u inodes, %u data blocks\n", out_file, num_entries, num_inodes, num_blocks);
+    return 0;
+}
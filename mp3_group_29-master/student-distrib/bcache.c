@@ -0,0 +1,163 @@
+#include "bcache.h"
+#include "filesys.h"
+
+/* Buffered copies of data blocks. Writes land here and reach the
+ * filesystem only when the block is evicted or flushed, so a file
+ * appended to in small pieces is written back a block at a time. */
+static datablock_t bcache_data[BCACHE_SIZE];
+
+typedef struct bcache_entry {
+    uint32_t block;         // data block number
+    uint32_t last_use;      // bcache_clock when last touched, for LRU
+    uint8_t valid;
+    uint8_t dirty;
+} bcache_entry_t;
+
+static bcache_entry_t bcache[BCACHE_SIZE];
+static uint32_t bcache_clock;
+static uint32_t bcache_dirty_blocks;
+
+/*
+ * DESCRIPTION: Copies a cached block back to the filesystem.
+ *
+ * INPUTS: i -- cache entry
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: entry is clean afterwards
+ */
+static void bcache_writeback(uint32_t i) {
+    if (!bcache[i].valid || !bcache[i].dirty) return;
+
+    memcpy((void *)fs_block_addr(bcache[i].block), &bcache_data[i], BLOCK_SIZE);
+    bcache[i].dirty = 0;
+    bcache_dirty_blocks--;
+}
+
+/*
+ * DESCRIPTION: Finds the cache entry of a block.
+ *
+ * INPUTS: block -- data block number
+ *
+ * OUTPUTS: entry index, BCACHE_SIZE if the block isn't cached
+ *
+ * SIDE EFFECTS: none
+ */
+static uint32_t bcache_find(uint32_t block) {
+    uint32_t i;
+
+    for (i = 0; i < BCACHE_SIZE; i++) {
+        if (bcache[i].valid && bcache[i].block == block) return i;
+    }
+
+    return BCACHE_SIZE;
+}
+
+void bcache_init(void) {
+    uint32_t i;
+
+    for (i = 0; i < BCACHE_SIZE; i++) {
+        bcache[i].valid = 0;
+        bcache[i].dirty = 0;
+    }
+
+    bcache_clock = 0;
+    bcache_dirty_blocks = 0;
+}
+
+/*
+ * DESCRIPTION: Gets a block into the cache for writing. Takes a free
+ * entry if there is one, otherwise the least recently used one, writing
+ * it back first if it is dirty.
+ *
+ * INPUTS: block -- data block number, fresh -- block has no contents
+ * yet, start from zeroes instead of reading it
+ *
+ * OUTPUTS: pointer to the cached copy
+ *
+ * SIDE EFFECTS: marks the block dirty, may write back another block
+ */
+uint8_t* bcache_modify(uint32_t block, int32_t fresh) {
+    uint32_t i, victim;
+
+    i = bcache_find(block);
+
+    if (i == BCACHE_SIZE) {
+        victim = 0;
+        for (i = 0; i < BCACHE_SIZE; i++) {
+            if (!bcache[i].valid) break;
+            if (bcache[i].last_use < bcache[victim].last_use) victim = i;
+        }
+        if (i == BCACHE_SIZE) {
+            i = victim;
+            bcache_writeback(i);
+        }
+
+        if (fresh) memset(&bcache_data[i], 0, BLOCK_SIZE);
+        else memcpy(&bcache_data[i], (void *)fs_block_addr(block), BLOCK_SIZE);
+
+        bcache[i].block = block;
+        bcache[i].valid = 1;
+        bcache[i].dirty = 0;
+    }
+
+    if (!bcache[i].dirty) {
+        bcache[i].dirty = 1;
+        bcache_dirty_blocks++;
+    }
+    bcache[i].last_use = ++bcache_clock;
+
+    return bcache_data[i].data;
+}
+
+uint8_t* bcache_lookup(uint32_t block) {
+    uint32_t i;
+
+    if (bcache_dirty_blocks == 0) return NULL;
+
+    i = bcache_find(block);
+    if (i == BCACHE_SIZE || !bcache[i].dirty) return NULL;
+
+    return bcache_data[i].data;
+}
+
+uint32_t bcache_dirty_count(void) {
+    return bcache_dirty_blocks;
+}
+
+void bcache_sync(uint32_t block) {
+    uint32_t i;
+
+    if (bcache_dirty_blocks == 0) return;
+
+    i = bcache_find(block);
+    if (i < BCACHE_SIZE) bcache_writeback(i);
+}
+
+/*
+ * DESCRIPTION: Writes every dirty block back to the filesystem. Blocks
+ * stay cached (clean).
+ *
+ * INPUTS: none
+ *
+ * OUTPUTS: number of blocks written
+ *
+ * SIDE EFFECTS: updates filesystem blocks
+ */
+int32_t bcache_flush(void) {
+    uint32_t i, flags;
+    int32_t count = 0;
+
+    cli_and_save(flags);
+
+    for (i = 0; i < BCACHE_SIZE && bcache_dirty_blocks > 0; i++) {
+        if (bcache[i].valid && bcache[i].dirty) {
+            bcache_writeback(i);
+            count++;
+        }
+    }
+
+    restore_flags(flags);
+
+    return count;
+}
@@ -0,0 +1,33 @@
+/*
+ * bcache.h - Write-back buffer cache for filesystem data blocks.
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _BCACHE_H
+#define _BCACHE_H
+
+#include "types.h"
+#include "lib.h"
+
+#define BCACHE_SIZE         32      // blocks buffered at once
+
+/* Empties the cache. */
+void bcache_init(void);
+
+/* Returns the cached copy of a block for writing, marking it dirty. The
+ * copy starts out with the block's contents, or zeroed if fresh is set
+ * (a block new to its file). Evicting for it may write back another. */
+uint8_t* bcache_modify(uint32_t block, int32_t fresh);
+
+/* Returns the cached copy of a block if it is newer than the block
+ * itself, NULL otherwise. */
+uint8_t* bcache_lookup(uint32_t block);
+
+/* Number of dirty blocks -- reads only look in the cache when it's not 0. */
+uint32_t bcache_dirty_count(void);
+
+/* Writes one block / every dirty block back to the filesystem. */
+void bcache_sync(uint32_t block);
+int32_t bcache_flush(void);
+
+#endif /* _BCACHE_H */
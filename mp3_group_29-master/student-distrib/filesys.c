@@ -1,4 +1,56 @@
 #include "filesys.h"
+#include "bcache.h"
+#include "frame.h"
+#include "lz.h"
+#include "pcache.h"
+
+/* Directory index: open addressed hash table of boot block dentries by
+ * name, holding dentry index + 1 (0 is an empty slot). */
+static uint8_t dentry_hash[DENTRY_HASH_SIZE];
+
+static uint32_t dentry_name_hash(const int8_t* name);
+
+/* Extent cache: the last run of consecutive data blocks read_data found
+ * for an inode, direct mapped by inode number. */
+static extent_t extent_cache[EXTENT_CACHE_SIZE];
+
+static uint32_t extent_lookup(inode_t* try_inode, uint32_t inode, uint32_t block, uint32_t max, uint32_t limit, uint32_t* disk_block);
+static void extent_invalidate(uint32_t inode);
+static void read_cached(uint32_t block, uint32_t offset_in_block, uint8_t* buf, uint32_t length);
+
+/* Block allocator: one bit per data block in use by a file. Blocks past
+ * the end of the loaded image are frames from frame_alloc. */
+static uint32_t block_used[FS_MAX_BLOCKS / 32];
+static uint32_t image_blocks;               // data blocks in the loaded image
+static uint32_t extra_block[FS_MAX_BLOCKS]; // frame of block image_blocks + i
+
+/* Number of user page table entries mapping each block (fs_block_map).
+ * Nothing is written to a mapped block -- writing the file moves it to a
+ * new block -- and it isn't reused until the last mapping goes. */
+static uint16_t block_maps[FS_MAX_BLOCKS];
+
+#define BLOCK_TEST(map, b)  ((map)[(b) >> 5] & (1 << ((b) & 31)))
+#define BLOCK_SET(map, b)   ((map)[(b) >> 5] |= (1 << ((b) & 31)))
+#define BLOCK_CLEAR(map, b) ((map)[(b) >> 5] &= ~(1 << ((b) & 31)))
+
+// blocks we can't track are treated as pinned
+#define BLOCK_PINNED(b)     ((b) >= FS_MAX_BLOCKS || block_maps[b] > 0)
+
+/* Compressed files (DENTRY_COMPRESSED), see read_compressed. Decoded
+ * pages are cached by the page cache, not here. */
+static uint32_t inode_compressed[FS_MAX_INODES / 32];
+
+#define INODE_COMPRESSED(i) ((i) < FS_MAX_INODES && BLOCK_TEST(inode_compressed, i))
+
+static uint8_t lz_scratch[BLOCK_SIZE];      // compressed block being decoded
+static uint8_t lz_block[BLOCK_SIZE];        // decoded block, for partial reads
+
+static void dentry_index_add(uint32_t index);
+static uint32_t file_blocks(uint32_t inode);
+static int32_t read_blocks(inode_t* try_inode, uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
+static int32_t read_compressed(inode_t* try_inode, uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
+static int32_t block_alloc(void);
+static int32_t inode_alloc(void);
 
 /*
  * DESCRIPTION: Initializes segments of file system, such as boot block, inodes, etc.
@@ -12,10 +64,79 @@
  * 
  */
 void filesys_init(uint32_t start_addr){
+    uint32_t i, b, n, inode;
+
     boot_block = (boot_block_t*)start_addr;         //init datablock pointer to start address
     data_entry = *(dentry_t*)(start_addr + 64); // starts at first directory entry, boot block is 64B
     inode_start = (inode_t*)(start_addr + BLOCK_SIZE);      //init inode_t pointer to 1 after start address
     data_block_start = (datablock_t *)(start_addr + (boot_block->inode_nums)*BLOCK_SIZE + BLOCK_SIZE);       //init data block pointer to 1 after inodes
+
+    // build the name index -- entries go in directory order, so with
+    // duplicate names the first one is found first, like the old scan
+    for (i = 0; i < DENTRY_HASH_SIZE; i++) dentry_hash[i] = 0;
+    for (i = 0; i < EXTENT_CACHE_SIZE; i++) extent_cache[i].length = 0;
+    for (i = 0; i < FS_MAX_INODES / 32; i++) inode_compressed[i] = 0;
+
+    for (i = 0; i < boot_block->dir_entries && i < MAX_DENTRIES; i++) dentry_index_add(i);
+
+    // blocks listed by the directory's files are in use, the rest are free
+    image_blocks = boot_block->data_block_num;
+    for (i = 0; i < FS_MAX_BLOCKS / 32; i++) block_used[i] = 0;
+    for (i = 0; i < FS_MAX_BLOCKS; i++) block_maps[i] = 0;
+
+    for (i = 0; i < boot_block->dir_entries && i < MAX_DENTRIES; i++) {
+        inode = boot_block->d[i].inode_num;
+        if (boot_block->d[i].filetype != FILE_ACCESS || inode >= boot_block->inode_nums) continue;
+
+        if ((boot_block->d[i].flags & DENTRY_COMPRESSED) && inode < FS_MAX_INODES)
+            BLOCK_SET(inode_compressed, inode);
+
+        for (b = 0, n = file_blocks(inode); b < n; b++) {
+            if (inode_start[inode].data_block[b] < FS_MAX_BLOCKS)
+                BLOCK_SET(block_used, inode_start[inode].data_block[b]);
+        }
+    }
+
+    bcache_init();
+    pcache_init();
+}
+
+/*
+ * DESCRIPTION: Adds a dentry to the directory index.
+ *
+ * INPUTS: index -- dentry index in the boot block
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: fills a slot of dentry_hash
+ */
+static void dentry_index_add(uint32_t index){
+    uint32_t slot = dentry_name_hash(boot_block->d[index].filename);
+
+    while (dentry_hash[slot]) slot = (slot + 1) & (DENTRY_HASH_SIZE - 1);
+    dentry_hash[slot] = index + 1;
+}
+
+/*
+ * DESCRIPTION: Hashes a file name (FNV-1a) into the directory index.
+ * Names are at most MAX_NAME_LENGTH chars and may not be terminated.
+ *
+ * INPUTS: name -- file name
+ *
+ * OUTPUTS: slot in dentry_hash
+ *
+ * SIDE EFFECTS: none
+ */
+static uint32_t dentry_name_hash(const int8_t* name){
+    uint32_t hash = 2166136261U; // FNV offset basis
+    int i;
+
+    for (i = 0; i < MAX_NAME_LENGTH && name[i]; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619U;       // FNV prime
+    }
+
+    return hash & (DENTRY_HASH_SIZE - 1);
 }
 
 /*
@@ -46,16 +167,16 @@ int32_t file_close(int32_t fd){
 */
 int32_t file_read(int32_t fd, void* buf, int32_t bytes)
 {
-    memset((uint8_t*) buf, NULL, bytes);
-    
     if(buf == NULL)
         return -1;
+
+    memset((uint8_t*) buf, NULL, bytes);
     
-    uint32_t bytes_read = read_data(terminals[disp_terminal].pcb->open_files[fd].inode_num, terminals[disp_terminal].pcb->open_files[fd].file_pos, buf, bytes);
+    int32_t bytes_read = pcache_read(curr_pcb->open_files[fd].inode_num, curr_pcb->open_files[fd].file_pos, buf, bytes);
 
     if (bytes_read < 0) return -1;
     // update file position
-    terminals[disp_terminal].pcb->open_files[fd].file_pos += bytes_read;
+    curr_pcb->open_files[fd].file_pos += bytes_read;
 
     return bytes_read;
 }
@@ -79,9 +200,31 @@ int32_t data_read(int32_t fd, void* buf, uint32_t bytes, uint32_t offset) {
     else return 0;
 }
 
-/* Should just return (see MP3 writup Checkpoint 2). */
+/*
+ * DESCRIPTION: Appends to a file. There is no seek, so writes always go
+ * to the end, which is what logs want.
+ *
+ * INPUTS: fd -- open file, buf -- data, bytes -- its length
+ *
+ * OUTPUTS: bytes written, -1 on failure
+ *
+ * SIDE EFFECTS: grows the file, data stays in the buffer cache until
+ * evicted or flushed
+ */
 int32_t file_write(int32_t fd, const void* buf, int32_t bytes){
-    return -1;
+    uint32_t inode, flags;
+    int32_t ret;
+
+    if (buf == NULL || bytes < 0) return -1;
+
+    inode = curr_pcb->open_files[fd].inode_num;
+
+    // nobody may append between reading the size and writing
+    cli_and_save(flags);
+    ret = write_data(inode, get_file_size(inode), buf, bytes);
+    restore_flags(flags);
+
+    return ret;
 }
 
 /*
@@ -122,7 +265,7 @@ int32_t dir_read(int32_t fd, void* buf, int32_t bytes){
 
     dentry_t dentry;
 
-    uint32_t index =  terminals[disp_terminal].pcb->open_files[fd].file_pos;
+    uint32_t index =  curr_pcb->open_files[fd].file_pos;
     int32_t ret = read_dentry_by_index(index, &dentry);
 
     if (ret == -1) return 0;
@@ -131,13 +274,56 @@ int32_t dir_read(int32_t fd, void* buf, int32_t bytes){
 
     // goes to next file
     index++;
-    terminals[disp_terminal].pcb->open_files[fd].file_pos = index;
+    curr_pcb->open_files[fd].file_pos = index;
 
     if (index < 63) return bytes; // 63 directory entries
 
     return 0;
 }
 
+/*
+ * DESCRIPTION: Reads as many directory entries as fit into buffer, packed
+ * as dirent_t records, so a directory can be listed with one syscall.
+ *
+ * INPUTS: fd - open directory, buf - to be written to, bytes - size of buf
+ *
+ * OUTPUTS: bytes filled, 0 at the end of the directory, -1 if the next
+ * entry doesn't fit
+ *
+ * SIDE EFFECTS: Fills buf, moves on past the entries read.
+ */
+int32_t dir_getdents(int32_t fd, void* buf, int32_t bytes){
+    dentry_t dentry;
+    dirent_t* ent;
+    uint32_t index, name_length, record, filled = 0;
+
+    if (buf == NULL || bytes < 0) return -1;
+
+    for (index = curr_pcb->open_files[fd].file_pos; read_dentry_by_index(index, &dentry) == 0; index++) {
+        for (name_length = 0; name_length < MAX_NAME_LENGTH && dentry.filename[name_length]; name_length++);
+
+        record = (sizeof(dirent_t) + name_length + 3) & ~3;
+        if (filled + record > (uint32_t)bytes) break;
+
+        ent = (dirent_t*)((uint8_t*)buf + filled);
+        ent->record_length = record;
+        ent->filetype = dentry.filetype;
+        ent->name_length = name_length;
+        ent->inode_num = dentry.inode_num;
+        ent->size = (dentry.filetype == FILE_ACCESS) ? get_file_size(dentry.inode_num) : 0;
+        memcpy((uint8_t*)ent + sizeof(dirent_t), dentry.filename, name_length);
+
+        filled += record;
+    }
+
+    // buffer too small for even one entry
+    if (filled == 0 && index < boot_block->dir_entries) return -1;
+
+    curr_pcb->open_files[fd].file_pos = index;
+
+    return filled;
+}
+
 /* Should just return (see MP3 writup Checkpoint 2). */
 int32_t dir_write(int32_t fd, const void* buf, int32_t bytes){
     return -1;
@@ -160,10 +346,12 @@ int32_t read_dentry_by_name (const uint8_t* fname, dentry_t* dentry){
     if (strlen((int8_t *)fname) > MAX_NAME_LENGTH) return -1;
 
     int i;
-    int dir_entries = boot_block->dir_entries;
+    uint32_t slot = dentry_name_hash((const int8_t*)fname);
+
+    // probe the index until an empty slot -- O(1) with the table at most half full
+    for(; dentry_hash[slot]; slot = (slot + 1) & (DENTRY_HASH_SIZE - 1)){
+        i = dentry_hash[slot] - 1;
 
-    for(i = 0; i < dir_entries; i++){
-        // dentry_t try_dentry = boot_block->d[i];
         // int cast to get compiler to stop complaining
         if(strncmp((int8_t*) fname, (int8_t*)boot_block->d[i].filename, MAX_NAME_LENGTH) == 0){
             strncpy((int8_t*)dentry->filename, (int8_t*)boot_block->d[i].filename, MAX_NAME_LENGTH); 
@@ -201,63 +389,541 @@ int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry){
  * INPUTS: inode -- inode of file, offset -- offset in bytes from file start,
  * buf -- buffer to write to, length -- number of bytes to write
  * 
- * OUTPUTS: 0 upon success, -1 on failure
+ * OUTPUTS: number of bytes read, -1 on failure
  * 
  * SIDE EFFECTS: Fills buffer with chars.
  * 
  */
 
 int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
+    uint32_t remain_length, flags;
+    int32_t ret;
+    inode_t* try_inode;
+
+    if (inode >= boot_block->inode_nums) return -1;
+    if (buf == NULL) return -1;
+
+    try_inode = &inode_start[inode];
 
-    // FIX TO ACCOUNT FOR OFFSET
+    // nothing left past the end of the file
+    if (offset >= try_inode->data_length) return 0;
+
+    // if length is over the remaining length of the file, then only copy up until end
+    remain_length = try_inode->data_length - offset;
+    if (remain_length > length) remain_length = length;
 
-    int i = 0;
-    uint32_t block_index = offset / BLOCK_SIZE; // offset in block
+    // a writer mustn't move blocks under us
+    cli_and_save(flags);
+
+    if (INODE_COMPRESSED(inode)) ret = read_compressed(try_inode, inode, offset, buf, remain_length);
+    else ret = read_blocks(try_inode, inode, offset, buf, remain_length);
+
+    restore_flags(flags);
+
+    if (ret == -1) return -1; // corrupt inode
+
+    // returns bytes read
+    return remain_length;
+}
+
+/*
+ * DESCRIPTION: Copies bytes of a file's block list as they are stored,
+ * one memcpy for each run of consecutive data blocks.
+ *
+ * INPUTS: try_inode -- the inode, inode -- its number, offset -- byte
+ * in the block list, buf -- buffer, length -- bytes (must not go past
+ * file_blocks)
+ *
+ * OUTPUTS: 0 upon success, -1 if the block list is corrupt
+ *
+ * SIDE EFFECTS: fills buf
+ */
+static int32_t read_blocks(inode_t* try_inode, uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
+    uint32_t block_index = offset / BLOCK_SIZE;     // first file block to read
     uint32_t offset_in_block = offset % BLOCK_SIZE;
+    uint32_t count, limit, disk_block, run, copied;
 
-    if (inode >= boot_block->inode_nums) return -1;
-    inode_t* try_inode = (inode_t *)(&inode_start[inode]);
+    // blocks the read touches
+    count = (offset_in_block + length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    limit = file_blocks(inode);
 
-    if (buf == NULL) return -1;
+    for (copied = 0; copied < length; block_index += run, count -= run) {
+        run = extent_lookup(try_inode, inode, block_index, count, limit, &disk_block);
+        if (run == 0) return -1;
 
-    // if length is over the remaining length of the file, then only copy up until end
-    int32_t remain_length = (try_inode->data_length - offset) < length ? (try_inode->data_length - offset) : length; // data length in bytes
-    int32_t ret = remain_length;
-    if (remain_length < 0) return -1; // should not happen
-
-    while(remain_length > 0) {
-        // user wants to copy more than remaining data
-        if (remain_length > BLOCK_SIZE) {
-            if (i == 0) {
-                memcpy(buf, &(data_block_start[try_inode->data_block[block_index + i]].data[offset_in_block]), BLOCK_SIZE - offset_in_block);
-                i++;
-                remain_length -= (BLOCK_SIZE - offset_in_block); // will copy from next block in next loop
-            }
-            else {
-                memcpy(&(buf[(i - 1) * BLOCK_SIZE + (BLOCK_SIZE - offset_in_block)]), &(data_block_start[try_inode->data_block[block_index + i]].data[0]), BLOCK_SIZE);
-                i++;
-                remain_length -= BLOCK_SIZE; // will copy from next block in next loop
-            }
+        run = run * BLOCK_SIZE - offset_in_block;
+        if (run > length - copied) run = length - copied;
+
+        memcpy(&buf[copied], (uint8_t *)fs_block_addr(disk_block) + offset_in_block, run);
+
+        // blocks written since the last flush are newer in the cache
+        if (bcache_dirty_count()) read_cached(disk_block, offset_in_block, &buf[copied], run);
+
+        copied += run;
+
+        run = (offset_in_block + run + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        offset_in_block = 0;
+    }
+
+    return 0;
+}
+
+/*
+ * DESCRIPTION: Reads from a compressed file. Each 4KB block of the file
+ * is compressed on its own (see lz.h), so any block can be decoded
+ * alone. The stored data starts with a table of uint32_t offsets, block
+ * i's compressed bytes running from entry i to entry i + 1; a block
+ * stored at its full size is stored raw. Nothing decoded is kept --
+ * file_read goes through the page cache, which reads whole blocks.
+ *
+ * INPUTS: try_inode -- the inode, inode -- its number, offset -- byte
+ * in the uncompressed file, buf -- buffer, length -- bytes (must not go
+ * past the end of the file)
+ *
+ * OUTPUTS: 0 upon success, -1 if the file is corrupt
+ *
+ * SIDE EFFECTS: fills buf
+ */
+static int32_t read_compressed(inode_t* try_inode, uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length){
+    uint32_t block, in_block, count, copied, size;
+    uint32_t range[2];
+    uint8_t* dst;
+
+    for (copied = 0; copied < length; copied += count) {
+        block = (offset + copied) / BLOCK_SIZE;
+        in_block = (offset + copied) % BLOCK_SIZE;
+        count = BLOCK_SIZE - in_block;
+        if (count > length - copied) count = length - copied;
+
+        size = try_inode->data_length - block * BLOCK_SIZE;
+        if (size > BLOCK_SIZE) size = BLOCK_SIZE;
+
+        // whole blocks are decoded straight into buf
+        dst = (in_block == 0 && count == size) ? &buf[copied] : lz_block;
+
+        if (read_blocks(try_inode, inode, block * sizeof(uint32_t), (uint8_t*)range, sizeof(range))) return -1;
+        if (range[1] < range[0] || range[1] - range[0] > size) return -1;
+        if (read_blocks(try_inode, inode, range[0], lz_scratch, range[1] - range[0])) return -1;
+
+        if (range[1] - range[0] == size) memcpy(dst, lz_scratch, size);
+        else if (lz_decompress(lz_scratch, range[1] - range[0], dst, size) == -1) return -1;
+
+        if (dst == lz_block) memcpy(&buf[copied], lz_block + in_block, count);
+    }
+
+    return 0;
+}
+
+/*
+ * DESCRIPTION: Number of data blocks an inode lists. For a compressed
+ * file that's what the compressed data takes, which the last entry of
+ * its offset table gives.
+ *
+ * INPUTS: inode -- inode number
+ *
+ * OUTPUTS: number of blocks, 0 if the inode is corrupt
+ *
+ * SIDE EFFECTS: none
+ */
+static uint32_t file_blocks(uint32_t inode){
+    inode_t* try_inode = &inode_start[inode];
+    uint32_t length = try_inode->data_length;
+    uint32_t last, addr;
+
+    if (INODE_COMPRESSED(inode) && length > 0) {
+        // the offset table's entries are 4 byte aligned, so never span blocks
+        last = ((length + BLOCK_SIZE - 1) / BLOCK_SIZE) * sizeof(uint32_t);
+        if (last / BLOCK_SIZE >= MAX_FILE_BLOCKS) return 0;
+
+        addr = fs_block_addr(try_inode->data_block[last / BLOCK_SIZE]);
+        if (!addr) return 0;
+
+        length = *(uint32_t*)(addr + last % BLOCK_SIZE);
+    }
+
+    length = (length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    return (length < MAX_FILE_BLOCKS) ? length : MAX_FILE_BLOCKS;
+}
+
+/*
+ * DESCRIPTION: Copies the dirty cached copies of a run of blocks over
+ * what read_data took from the blocks themselves.
+ *
+ * INPUTS: block -- first data block, offset_in_block -- where the read
+ * starts in it, buf -- read_data's buffer for the run, length -- bytes
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: fills parts of buf
+ */
+static void read_cached(uint32_t block, uint32_t offset_in_block, uint8_t* buf, uint32_t length){
+    uint32_t count;
+    uint8_t* data;
+
+    for (; length > 0; block++, buf += count, length -= count, offset_in_block = 0) {
+        count = BLOCK_SIZE - offset_in_block;
+        if (count > length) count = length;
+
+        data = bcache_lookup(block);
+        if (data) memcpy(buf, data + offset_in_block, count);
+    }
+}
+
+/*
+ * DESCRIPTION: Finds the extent (run of consecutive data blocks) that
+ * holds a block of a file. The last extent found for each inode is
+ * cached, so sequential reads in small chunks don't rescan the block
+ * list every call.
+ *
+ * INPUTS: try_inode -- the inode, inode -- its number, block -- block
+ * index in the file, max -- blocks wanted, limit -- blocks the inode
+ * lists (file_blocks)
+ *
+ * OUTPUTS: number of consecutive blocks from block (at most max), 0 if
+ * the block list is corrupt; *disk_block is the data block of block
+ *
+ * SIDE EFFECTS: updates the extent cache
+ */
+static uint32_t extent_lookup(inode_t* try_inode, uint32_t inode, uint32_t block, uint32_t max, uint32_t limit, uint32_t* disk_block){
+    extent_t* ext = &extent_cache[inode % EXTENT_CACHE_SIZE];
+    uint32_t first, addr, run;
+
+    if (ext->length && ext->inode == inode && block >= ext->block && block < ext->block + ext->length) {
+        run = ext->block + ext->length - block;
+        *disk_block = ext->start + (block - ext->block);
+        return run < max ? run : max;
+    }
+
+    if (block >= limit) return 0;
+    first = try_inode->data_block[block];
+    addr = fs_block_addr(first);
+    if (!addr) return 0;
+
+    // grow the extent to the end of the file's blocks -- blocks added
+    // past the image are numbered in order but needn't be adjacent
+    run = 1;
+    while (block + run < limit &&
+           try_inode->data_block[block + run] == first + run &&
+           fs_block_addr(first + run) == addr + run * BLOCK_SIZE) {
+        run++;
+    }
+
+    ext->inode = inode;
+    ext->block = block;
+    ext->start = first;
+    ext->length = run;
+
+    *disk_block = first;
+    return run < max ? run : max;
+}
+
+/*
+ * DESCRIPTION: Forgets the cached extent of an inode whose blocks changed.
+ *
+ * INPUTS: inode -- inode number
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: none
+ */
+static void extent_invalidate(uint32_t inode){
+    extent_t* ext = &extent_cache[inode % EXTENT_CACHE_SIZE];
+
+    if (ext->inode == inode) ext->length = 0;
+}
+
+/*
+ * DESCRIPTION: Writes data into a file, growing it if the write goes
+ * past its end. Blocks are written through the buffer cache; one that is
+ * mapped into a process is first copied to a new block, so the process
+ * keeps seeing the old data.
+ *
+ * INPUTS: inode -- inode of file, offset -- where to start (at most the
+ * file size, there are no holes), buf -- data, length -- bytes to write
+ *
+ * OUTPUTS: bytes written (short if the filesystem filled up), -1 on
+ * failure
+ *
+ * SIDE EFFECTS: may allocate data blocks, changes the inode
+ */
+int32_t write_data (uint32_t inode, uint32_t offset, const uint8_t* buf, uint32_t length){
+    uint32_t index, in_block, count, written, blocks, old, flags;
+    int32_t block;
+    uint8_t* data;
+    inode_t* try_inode;
+
+    if (inode >= boot_block->inode_nums || buf == NULL) return -1;
+
+    // compressed files are read-only
+    if (INODE_COMPRESSED(inode)) return -1;
+
+    try_inode = &inode_start[inode];
+
+    if (offset > try_inode->data_length || offset > MAX_FILE_BLOCKS * BLOCK_SIZE) return -1;
+
+    // files can't outgrow their inode's block list
+    if (length > MAX_FILE_BLOCKS * BLOCK_SIZE - offset) length = MAX_FILE_BLOCKS * BLOCK_SIZE - offset;
+
+    cli_and_save(flags);
+
+    blocks = (try_inode->data_length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    for (written = 0; written < length; written += count) {
+        index = (offset + written) / BLOCK_SIZE;
+        in_block = (offset + written) % BLOCK_SIZE;
+        count = BLOCK_SIZE - in_block;
+        if (count > length - written) count = length - written;
 
+        if (index >= blocks) {
+            // past the last block -- give the file a new one
+            if ((block = block_alloc()) < 0) break;
+
+            try_inode->data_block[index] = block;
+            blocks++;
+            data = bcache_modify(block, 1);
         }
         else {
-            if (i == 0) {
-                memcpy(buf, &(data_block_start[try_inode->data_block[block_index + i]].data[offset_in_block]), remain_length);
-                break;
-            }
-            else {
-                memcpy(&(buf[(i - 1) * BLOCK_SIZE + (BLOCK_SIZE - offset_in_block)]), &(data_block_start[try_inode->data_block[block_index + i]].data[0]), remain_length);
-                break;
+            old = try_inode->data_block[index];
+            if (!fs_block_addr(old)) break;
+
+            if (BLOCK_PINNED(old)) {
+                // a process maps this block -- move the file off it
+                if ((block = block_alloc()) < 0) break;
+
+                data = bcache_modify(block, 1);
+                memcpy(data, (void *)fs_block_addr(old), BLOCK_SIZE);
+
+                try_inode->data_block[index] = block;
+                if (old < FS_MAX_BLOCKS) BLOCK_CLEAR(block_used, old);
             }
+            else data = bcache_modify(old, 0);
+        }
+
+        memcpy(data + in_block, buf + written, count);
+
+        if (offset + written + count > try_inode->data_length) try_inode->data_length = offset + written + count;
+    }
+
+    extent_invalidate(inode);
+    if (written > 0) pcache_invalidate(inode, offset);
+
+    restore_flags(flags);
+
+    if (written == 0 && length > 0) return -1;
+
+    return written;
+}
+
+/*
+ * DESCRIPTION: Allocates a free data block, adding one past the end of
+ * the image when all of its blocks are used.
+ *
+ * INPUTS: none
+ *
+ * OUTPUTS: block number, -1 if the filesystem is full
+ *
+ * SIDE EFFECTS: marks block used, may allocate a frame
+ */
+static int32_t block_alloc(void){
+    uint32_t b, frame;
 
+    for (b = 0; b < boot_block->data_block_num && b < FS_MAX_BLOCKS; b++) {
+        if (!BLOCK_TEST(block_used, b) && block_maps[b] == 0) {
+            BLOCK_SET(block_used, b);
+            return b;
         }
     }
 
-    // returns bytes read
-    return ret;
+    if (b >= FS_MAX_BLOCKS) return -1;
+
+    frame = frame_alloc();
+    if (!frame) return -1;
+
+    extra_block[b - image_blocks] = frame;
+    boot_block->data_block_num++;
+
+    BLOCK_SET(block_used, b);
+    return b;
+}
+
+/*
+ * DESCRIPTION: Allocates an inode no file in the directory uses.
+ *
+ * INPUTS: none
+ *
+ * OUTPUTS: inode number, -1 if all are used
+ *
+ * SIDE EFFECTS: truncates the inode to 0 bytes
+ */
+static int32_t inode_alloc(void){
+    uint32_t i, j;
+
+    for (i = 0; i < boot_block->inode_nums; i++) {
+        for (j = 0; j < boot_block->dir_entries; j++) {
+            if (boot_block->d[j].filetype == FILE_ACCESS && boot_block->d[j].inode_num == i) break;
+        }
+
+        if (j == boot_block->dir_entries) {
+            inode_start[i].data_length = 0;
+            extent_invalidate(i);
+            pcache_invalidate(i, 0);
+
+            if (INODE_COMPRESSED(i)) BLOCK_CLEAR(inode_compressed, i);
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * DESCRIPTION: Creates an empty regular file.
+ *
+ * INPUTS: fname -- name of the new file
+ *
+ * OUTPUTS: 0 upon success, -1 if the name is invalid or taken, or the
+ * directory or inodes are full
+ *
+ * SIDE EFFECTS: adds a dentry to the boot block
+ */
+int32_t fs_create (const uint8_t* fname){
+    dentry_t dentry;
+    dentry_t* new_dentry;
+    uint32_t length, flags;
+    int32_t inode;
+
+    if (fname == NULL) return -1;
+
+    length = strlen((int8_t *)fname);
+    if (length == 0 || length > MAX_NAME_LENGTH) return -1;
+
+    cli_and_save(flags);
+
+    if (read_dentry_by_name(fname, &dentry) == 0 || boot_block->dir_entries >= MAX_DENTRIES ||
+        (inode = inode_alloc()) < 0) {
+        restore_flags(flags);
+        return -1;
+    }
+
+    new_dentry = &boot_block->d[boot_block->dir_entries];
+    memset(new_dentry, 0, sizeof(dentry_t));
+    strncpy(new_dentry->filename, (int8_t *)fname, MAX_NAME_LENGTH);
+    new_dentry->filetype = FILE_ACCESS;
+    new_dentry->inode_num = inode;
+
+    dentry_index_add(boot_block->dir_entries++);
+
+    restore_flags(flags);
+
+    return 0;
 }
 
 int32_t get_file_size(int32_t inode_index)
 {
     return ((inode_t*)(&(inode_start[inode_index])))->data_length;
 }
+
+/*
+ * DESCRIPTION: Finds a data block in memory -- in the image, or a frame
+ * for blocks the filesystem grew by.
+ *
+ * INPUTS: block -- data block number
+ *
+ * OUTPUTS: address of the block, 0 if there is no such block
+ *
+ * SIDE EFFECTS: none
+ */
+uint32_t fs_block_addr(uint32_t block)
+{
+    if (block < image_blocks) return (uint32_t)&data_block_start[block];
+    if (block < boot_block->data_block_num) return extra_block[block - image_blocks];
+
+    return 0;
+}
+
+/*
+ * DESCRIPTION: Finds the data block that holds a byte of a file, to be
+ * mapped straight into a process. Data blocks are 4KB, so when the image
+ * is page aligned each block is also a physical page. Whoever maps it
+ * counts the mapping with fs_block_map, so writes to the file go to a
+ * new block while it is mapped.
+ *
+ * INPUTS: inode -- file's inode, offset -- byte in the file
+ *
+ * OUTPUTS: address of the block, 0 if out of range or not page aligned
+ *
+ * SIDE EFFECTS: writes back the block's cached data
+ */
+uint32_t file_block_addr(uint32_t inode, uint32_t offset)
+{
+    uint32_t block, addr, flags;
+
+    if (inode >= boot_block->inode_nums || offset >= inode_start[inode].data_length) return 0;
+
+    // a compressed file's blocks don't hold its contents
+    if (INODE_COMPRESSED(inode)) return 0;
+
+    cli_and_save(flags);
+
+    block = inode_start[inode].data_block[offset / BLOCK_SIZE];
+    addr = fs_block_addr(block);
+
+    if (addr && (addr & (BLOCK_SIZE - 1)) == 0) {
+        // the process sees the block itself, not the cache
+        bcache_sync(block);
+    }
+    else addr = 0;
+
+    restore_flags(flags);
+
+    return addr;
+}
+
+/*
+ * DESCRIPTION: Finds the data block at an address from fs_block_addr.
+ *
+ * INPUTS: addr -- address of the block
+ *
+ * OUTPUTS: block number, FS_MAX_BLOCKS if addr is no block we track
+ *
+ * SIDE EFFECTS: none
+ */
+static uint32_t fs_block_number(uint32_t addr)
+{
+    uint32_t b;
+
+    if (addr >= (uint32_t)data_block_start && addr < (uint32_t)&data_block_start[image_blocks])
+        return (addr - (uint32_t)data_block_start) / BLOCK_SIZE;
+
+    // blocks the filesystem grew by are frames anywhere in memory
+    for (b = image_blocks; b < boot_block->data_block_num && b < FS_MAX_BLOCKS; b++) {
+        if (extra_block[b - image_blocks] == addr) return b;
+    }
+
+    return FS_MAX_BLOCKS;
+}
+
+void fs_block_map(uint32_t addr)
+{
+    uint32_t block, flags;
+
+    cli_and_save(flags);
+
+    block = fs_block_number(addr);
+    if (block < FS_MAX_BLOCKS) block_maps[block]++;
+
+    restore_flags(flags);
+}
+
+void fs_block_unmap(uint32_t addr)
+{
+    uint32_t block, flags;
+
+    cli_and_save(flags);
+
+    block = fs_block_number(addr);
+    if (block < FS_MAX_BLOCKS && block_maps[block] > 0) block_maps[block]--;
+
+    restore_flags(flags);
+}
@@ -41,6 +41,9 @@ int32_t dir_close(int32_t fd); // fd is file descriptor
 /* Reads 'bytes' bytes to 'buf.' */
 int32_t dir_read(int32_t fd, void* buf, int32_t bytes);
 
+/* Fills 'buf' with as many dirent_t records as fit. */
+int32_t dir_getdents(int32_t fd, void* buf, int32_t bytes);
+
 /* Should just return (see MP3 writup Checkpoint 2). */
 int32_t dir_write(int32_t fd, const void* buf, int32_t bytes);
 
@@ -50,6 +53,18 @@ int32_t read_dentry_by_name (const uint8_t* fname, dentry_t* dentry);
 int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry);
 //read data of length at inode starting at offset and write it into buf
 int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
+//write length bytes of buf into inode at offset (at most the end of the file), growing it
+int32_t write_data (uint32_t inode, uint32_t offset, const uint8_t* buf, uint32_t length);
+//add an empty file to the directory
+int32_t fs_create (const uint8_t* fname);
+//address of a data block in memory, 0 if there is no such block
+uint32_t fs_block_addr (uint32_t block);
 
 extern int32_t get_file_size(int32_t inode_index);
+
+//address of the page-aligned data block holding offset, so it can be mapped directly
+extern uint32_t file_block_addr(uint32_t inode, uint32_t offset);
+//count a user mapping of a block added / removed -- a mapped block isn't written or reused
+extern void fs_block_map(uint32_t addr);
+extern void fs_block_unmap(uint32_t addr);
 #endif
@@ -0,0 +1,211 @@
+#include "frame.h"
+
+/* One bit per 4KB frame of physical memory, set while the frame is in
+ * use. Frames outside [frame_first, frame_end) -- the kernel, the
+ * filesystem image, video memory, missing RAM -- stay set forever. */
+static uint32_t frame_map[MAX_FRAMES / 32];
+
+/* Number of users of each frame in use -- page tables sharing a frame
+ * copy on write each hold a reference. */
+static uint16_t frame_refs[MAX_FRAMES];
+
+static uint32_t frame_first;        // first frame handed out
+static uint32_t frame_end;          // one past the last frame of RAM
+static uint32_t frame_hint;         // next single frame search starts here
+static uint32_t frame_free_count;
+
+#define FRAME_USED(f)   (frame_map[(f) >> 5] & (1 << ((f) & 31)))
+#define FRAME_SET(f)    (frame_map[(f) >> 5] |= (1 << ((f) & 31)))
+#define FRAME_CLEAR(f)  (frame_map[(f) >> 5] &= ~(1 << ((f) & 31)))
+
+/*
+ * DESCRIPTION: Initializes the frame allocator and maps the memory it
+ * manages into kernel space, so allocated frames can be used directly at
+ * their physical address.
+ *
+ * INPUTS: mem_top -- end of physical RAM, reserved_end -- end of memory
+ * the kernel already uses (boot modules)
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: marks every usable frame free, changes kernel paging
+ */
+void frame_init(uint32_t mem_top, uint32_t reserved_end) {
+    uint32_t f;
+
+    if (mem_top > USER_MEM) mem_top = USER_MEM;
+    if (reserved_end < EIGHT_MB_SIZE) reserved_end = EIGHT_MB_SIZE;
+
+    frame_first = (reserved_end + FOUR_KB_SIZE - 1) / FOUR_KB_SIZE;
+    frame_end = mem_top / FOUR_KB_SIZE;
+    frame_hint = frame_first;
+    frame_free_count = 0;
+
+    for (f = 0; f < MAX_FRAMES / 32; f++) frame_map[f] = 0xFFFFFFFF;
+
+    for (f = frame_first; f < frame_end; f++) {
+        FRAME_CLEAR(f);
+        frame_free_count++;
+    }
+
+    map_physical_memory(mem_top);
+}
+
+/*
+ * DESCRIPTION: Allocates a single frame. Searches on from the last
+ * allocation so repeated calls don't rescan the used part of memory.
+ *
+ * INPUTS: none
+ *
+ * OUTPUTS: physical address of the frame, 0 if memory is full
+ *
+ * SIDE EFFECTS: marks frame used
+ */
+uint32_t frame_alloc(void) {
+    uint32_t f = frame_hint;
+    uint32_t n;
+
+    if (frame_free_count == 0) return 0;
+
+    for (n = frame_first; n < frame_end; n++) {
+        if (f >= frame_end) f = frame_first;
+
+        // skip 32 used frames at a time
+        if ((f & 31) == 0 && frame_map[f >> 5] == 0xFFFFFFFF && f + 32 <= frame_end) {
+            f += 32;
+            n += 31;
+            continue;
+        }
+
+        if (!FRAME_USED(f)) {
+            FRAME_SET(f);
+            frame_refs[f] = 1;
+            frame_free_count--;
+            frame_hint = f + 1;
+            return f * FOUR_KB_SIZE;
+        }
+        f++;
+    }
+
+    return 0;
+}
+
+/*
+ * DESCRIPTION: Allocates a run of physically contiguous frames, e.g. a
+ * kernel stack or a 4MB page.
+ *
+ * INPUTS: count -- number of frames, align -- the first frame number must
+ * be a multiple of this
+ *
+ * OUTPUTS: physical address of the first frame, 0 if no run is free
+ *
+ * SIDE EFFECTS: marks frames used
+ */
+uint32_t frame_alloc_contig(uint32_t count, uint32_t align) {
+    uint32_t start, f;
+
+    if (count == 0 || count > frame_free_count) return 0;
+    if (align == 0) align = 1;
+
+    start = (frame_first + align - 1) / align * align;
+
+    while (start + count <= frame_end) {
+        for (f = start; f < start + count; f++) {
+            if (FRAME_USED(f)) break;
+        }
+
+        if (f == start + count) {
+            for (f = start; f < start + count; f++) {
+                FRAME_SET(f);
+                frame_refs[f] = 1;
+            }
+            frame_free_count -= count;
+            return start * FOUR_KB_SIZE;
+        }
+
+        // run is broken at f -- next candidate starts after it
+        start = (f + align) / align * align;
+    }
+
+    return 0;
+}
+
+/*
+ * DESCRIPTION: Adds a user to an allocated frame, so it takes one more
+ * frame_free before it is really freed.
+ *
+ * INPUTS: addr -- physical address of the frame
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: bumps reference count
+ */
+void frame_ref(uint32_t addr) {
+    uint32_t f = addr / FOUR_KB_SIZE;
+
+    if (f < frame_first || f >= frame_end || !FRAME_USED(f)) return;
+
+    frame_refs[f]++;
+}
+
+/*
+ * DESCRIPTION: Reports how many users a frame has.
+ *
+ * INPUTS: addr -- physical address of the frame
+ *
+ * OUTPUTS: reference count, 0 for free or unmanaged frames
+ *
+ * SIDE EFFECTS: none
+ */
+uint32_t frame_refcount(uint32_t addr) {
+    uint32_t f = addr / FOUR_KB_SIZE;
+
+    if (f < frame_first || f >= frame_end || !FRAME_USED(f)) return 0;
+
+    return frame_refs[f];
+}
+
+/*
+ * DESCRIPTION: Drops a reference to a frame from frame_alloc, freeing it
+ * when it was the last one.
+ *
+ * INPUTS: addr -- physical address of the frame
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: frame may be handed out again
+ */
+void frame_free(uint32_t addr) {
+    frame_free_contig(addr, 1);
+}
+
+/*
+ * DESCRIPTION: Drops a reference to each of a run of frames from
+ * frame_alloc_contig.
+ *
+ * INPUTS: addr -- physical address of the first frame, count -- frames
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: frames may be handed out again
+ */
+void frame_free_contig(uint32_t addr, uint32_t count) {
+    uint32_t f = addr / FOUR_KB_SIZE;
+
+    for (; count > 0; count--, f++) {
+        if (f < frame_first || f >= frame_end || !FRAME_USED(f)) continue;
+
+        if (--frame_refs[f] > 0) continue;
+
+        FRAME_CLEAR(f);
+        frame_free_count++;
+    }
+}
+
+uint32_t frames_total(void) {
+    return (frame_end > frame_first) ? frame_end - frame_first : 0;
+}
+
+uint32_t frames_free(void) {
+    return frame_free_count;
+}
@@ -0,0 +1,40 @@
+/*
+ * frame.h - Physical page frame allocator.
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _FRAME_H
+#define _FRAME_H
+
+#include "types.h"
+#include "lib.h"
+#include "paging.h"
+
+/* The kernel can only reach physical memory it has mapped, which is
+ * everything below the user program page at 128MB. */
+#define MAX_FRAMES          (USER_MEM / FOUR_KB_SIZE)
+
+#define PCB_FRAMES          (EIGHT_KB_SIZE / FOUR_KB_SIZE)  // PCB + kernel stack
+
+/* Takes over RAM between reserved_end (at least 8MB) and mem_top. */
+void frame_init(uint32_t mem_top, uint32_t reserved_end);
+
+/* Returns the physical address of a free 4KB frame, 0 if out of memory. */
+uint32_t frame_alloc(void);
+
+/* Returns count physically contiguous frames starting on a multiple of
+ * align frames, 0 if no such run is free. */
+uint32_t frame_alloc_contig(uint32_t count, uint32_t align);
+
+/* Frames are reference counted: allocation takes the first reference,
+ * frame_ref adds one and frame_free drops one (the last frees it). */
+void frame_ref(uint32_t addr);
+uint32_t frame_refcount(uint32_t addr);
+void frame_free(uint32_t addr);
+void frame_free_contig(uint32_t addr, uint32_t count);
+
+/* Number of frames managed in total / currently free. */
+uint32_t frames_total(void);
+uint32_t frames_free(void);
+
+#endif /* _FRAME_H */
@@ -1,12 +1,15 @@
 #include "i8253.h"
 
+// ticks programmed into the pending one-shot, 0 if none is pending
+static uint32_t pit_armed_ticks = 0;
+
 /* i8253_init
  * 
  * DESCRIPTION: Initializes PIT. Code is taken from x86 assembly version
- * from https://wiki.osdev.org/Programmable_Interval_Timer. Here we
- * opt to set the frequency of interrupts to approximately one per
- * 10 ms, so the frequency conversion and validation code is not
- * needed.
+ * from https://wiki.osdev.org/Programmable_Interval_Timer. The PIT is
+ * put in one-shot mode (mode 0) and left stopped; the scheduler arms it
+ * with pit_set_deadline only when some process actually has to be
+ * preempted, so an idle system gets no timer interrupts at all.
  * 
  * INPUTS: none
  * 
@@ -15,112 +18,96 @@
  * SIDE EFFECTS: initializes i8253
  */
 void i8253_init(void){
-    int32_t freq = FREQUENCY; // sets frequency of interrupts to 10ms
-    int32_t low_byte  = freq &  0xFF;    // only want lowest 8 bits
-    int32_t high_byte = freq >> 8;       // only want highest 8 bits
-
     // Initializes PIT - selects command register
     // 0x30 - Channel 0, low byte/high bytes
-    // 0x04 - Mode 4, software triggered strobe
-
-    outb(PIT_PORT, CMD_REG);  
+    // 0x00 - Mode 0, interrupt on terminal count
+    // counting doesn't start until a count is written
+    outb(PIT_ONESHOT, CMD_REG);
 
-    outb(low_byte,  CHANNEL_0);
-    outb(high_byte, CHANNEL_0);
+    pit_armed_ticks = 0;
 
     enable_irq(PIT_IRQ);
 }
 
-/* pit_handler
- *
- * INPUTS: none
+/* pit_set_deadline
+ * 
+ * DESCRIPTION: Arms a one-shot PIT interrupt approximately ticks * 10ms
+ * from now, replacing any pending one. Deadlines longer than the counter
+ * can hold are clipped; the scheduler re-arms when it fires.
+ * 
+ * INPUTS: ticks -- number of ~10ms scheduler ticks until the interrupt
  * 
  * OUTPUTS: none
  * 
- * SIDE EFFECTS: Switches between tasks in a round-robin fashion
- * at approximately every 10ms.
+ * SIDE EFFECTS: reprograms channel 0
  */
-void pit_handler(void)
-{
-    // TODO: round-robin scheduling... I cry
-    
-    // get current pcb
-    PCB_t * curr_pcb = terminals[exec_terminal].pcb;
-    PCB_t * next_pcb;
-
-    // if no program currently running, execute shell
-    if (!curr_pcb) {
+void pit_set_deadline(uint32_t ticks){
+    int32_t count;
 
-        PCB_t pcb;
+    if (ticks == 0) ticks = 1;
+    if (ticks > PIT_MAX_TICKS) ticks = PIT_MAX_TICKS;
 
-        //save esp and ebp
-        asm volatile(
-            "movl %%esp, %0       \n"
-            "movl %%ebp, %1       \n"
-            : "=r" (pcb.user_esp), "=r" (pcb.user_ebp)
-            :
-            : "memory"
-        );
+    count = FREQUENCY * ticks;
 
-        pcb.scheduled = 1;
+    // writing the mode restarts the counter once the count is loaded
+    outb(PIT_ONESHOT, CMD_REG);
+    outb(count & 0xFF, CHANNEL_0);  // only want lowest 8 bits
+    outb(count >> 8,   CHANNEL_0);  // only want highest 8 bits
 
-        // set executing terminal's pcb to this pcb
-        terminals[exec_terminal].pcb = &pcb;
-
-        // switch executing terminal to be displayed
-        switch_terminal(exec_terminal);
-
-        // for user to keep track of current terminal
-        printf("Terminal %d\n", exec_terminal + 1);
-
-        send_eoi(PIT_IRQ);
-
-        // start shell
-        execute((uint8_t *)"shell");
-    }
-
-    // save esp and ebp
-    asm volatile(
-        "movl %%esp, %0       \n"
-        "movl %%ebp, %1       \n"
-        : "=r" (curr_pcb->user_esp), "=r" (curr_pcb->user_ebp)
-        :
-        : "memory"
-    ); 
+    pit_armed_ticks = ticks;
+}
 
-    // switch terminal execution
-    exec_terminal++;
-    exec_terminal %= 3; // 0-2 are terminal numbers
+/* pit_clear_deadline
+ * 
+ * DESCRIPTION: Cancels the pending one-shot, if any.
+ * 
+ * INPUTS: none
+ * 
+ * OUTPUTS: none
+ * 
+ * SIDE EFFECTS: stops channel 0
+ */
+void pit_clear_deadline(void){
+    if (!pit_armed_ticks) return;
 
-    // return if no pcb -- will be handled in next interrupt
-    if(!terminals[exec_terminal].pcb) {
-        send_eoi(PIT_IRQ);
-        return;
-    } 
+    // a mode write without a count stops the counter
+    outb(PIT_ONESHOT, CMD_REG);
 
-    // remaps and sets video memory in paging
-    switch_vid();
-    set_vidmem(exec_terminal);
+    pit_armed_ticks = 0;
+}
 
-    // gets pcb of process we're switching to
-    next_pcb = terminals[exec_terminal].pcb;
+/* pit_deadline_armed
+ * 
+ * INPUTS: none
+ * 
+ * OUTPUTS: ticks programmed into the pending one-shot, 0 if none
+ * 
+ * SIDE EFFECTS: none
+ */
+uint32_t pit_deadline_armed(void){
+    return pit_armed_ticks;
+}
 
-    // switches paging
-    uint32_t addr = EIGHT_MB_SIZE + FOUR_MB_SIZE * next_pcb->pid;
-    switch_pd(addr); 
+/* pit_handler
+ *
+ * INPUTS: none
+ * 
+ * OUTPUTS: none
+ * 
+ * SIDE EFFECTS: Charges the running process for the ticks the one-shot
+ * covered and switches processes when its quantum runs out (see
+ * scheduler.c), which also arms the next deadline.
+ */
+void pit_handler(void)
+{
+    uint32_t elapsed = pit_armed_ticks;
 
-    // updates tss
-    tss.ss0 = KERNEL_DS;
-    tss.esp0 = EIGHT_MB_SIZE - EIGHT_KB_SIZE * (next_pcb->pid);
+    pit_armed_ticks = 0;
 
     send_eoi(PIT_IRQ);
 
-    // save esp and ebp
-    asm volatile(
-        "movl %0, %%esp       \n"
-        "movl %1, %%ebp       \n"
-        :
-        : "r" (next_pcb->user_esp), "r" (next_pcb->user_ebp)
-        : "esp" , "ebp"
-    );
+    // stray interrupt from a cancelled deadline
+    if (!elapsed) return;
+
+    sched_tick(elapsed);
 }
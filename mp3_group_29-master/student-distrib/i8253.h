@@ -1,14 +1,28 @@
+#ifndef _I8253_H
+#define _I8253_H
+
 #include "lib.h"
 #include "types.h"
 #include "keyboard.h"
 #include "paging.h"
+#include "scheduler.h"
 
 #define FREQUENCY 			    11932
 #define CHANNEL_0 				0x40
 #define CMD_REG					0x43
 #define PIT_PORT                0x34
+#define PIT_ONESHOT             0x30    // channel 0, lo/hi byte, mode 0
 #define PIT_IRQ                 0x00
 
+// longest one-shot the 16 bit counter can hold, in ~10ms ticks
+#define PIT_MAX_TICKS           (0xFFFF / FREQUENCY)
+
 void i8253_init(void);
 void pit_handler(void);
 
+// deadline tracker -- one-shot interrupt after some number of ticks
+void pit_set_deadline(uint32_t ticks);
+void pit_clear_deadline(void);
+uint32_t pit_deadline_armed(void);
+
+#endif /* _I8253_H */
@@ -123,3 +123,25 @@ void exception_handler(uint32_t index)
     // printf("RESULT = PASS\n");
     halt(255);
 }
+
+/*
+ * DESCRIPTION: Handles page faults. Faults demand paging can resolve
+ * return so the instruction is retried, anything else is an exception.
+ *
+ * INPUTS: addr -- faulting address, error -- error code pushed by the CPU
+ *
+ * OUTPUTS: None
+ *
+ * SIDE EFFECTS: Maps a user page or halts the program.
+ */
+void page_fault_handler(uint32_t addr, uint32_t error)
+{
+    // exceptions come in through trap gates -- don't let the scheduler
+    // run another process in the middle of mapping a page
+    cli();
+
+    if (handle_page_fault(addr, error) == 0)
+        return;
+
+    exception_handler(14); // page fault
+}
@@ -34,6 +34,9 @@
     /* Handles exceptions. */
     void exception_handler(uint32_t index);
 
+    /* Handles page faults (demand paging). */
+    void page_fault_handler(uint32_t addr, uint32_t error);
+
 
     /* Signatures for interrupts. */
     void divide_error_exception(void); /*idt[0]*/
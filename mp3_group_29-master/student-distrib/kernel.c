@@ -17,6 +17,8 @@
 #include "terminal.h"
 //#include "syscalls.h"
 #include "i8253.h"
+#include "scheduler.h"
+#include "kmalloc.h"
 #include "types.h"
 
 #define RUN_TESTS
@@ -25,13 +27,19 @@
 /* Check if the bit BIT in FLAGS is set. */
 #define CHECK_FLAG(flags, bit)   ((flags) & (1 << (bit)))
 
+/* RAM assumed if the boot loader doesn't tell us (the old fixed layout
+ * of 8MB kernel + six 4MB programs). */
+#define DEFAULT_MEM_TOP 0x2000000
+
 unsigned int fs_base_address = 0;
+unsigned int fs_end_address = 0;
 
 /* Check if MAGIC is valid and print the Multiboot information structure
    pointed by ADDR. */
 void entry(unsigned long magic, unsigned long addr) {
 
     multiboot_info_t *mbi;
+    unsigned int mem_top = DEFAULT_MEM_TOP;
 
     /* Clear the screen. */
     clear();
@@ -49,8 +57,10 @@ void entry(unsigned long magic, unsigned long addr) {
     printf("flags = 0x%#x\n", (unsigned)mbi->flags);
 
     /* Are mem_* valid? */
-    if (CHECK_FLAG(mbi->flags, 0))
+    if (CHECK_FLAG(mbi->flags, 0)) {
         printf("mem_lower = %uKB, mem_upper = %uKB\n", (unsigned)mbi->mem_lower, (unsigned)mbi->mem_upper);
+        mem_top = (mbi->mem_upper + 1024) * 1024; // mem_upper starts at 1MB
+    }
 
     /* Is boot_device valid? */
     if (CHECK_FLAG(mbi->flags, 1))
@@ -66,6 +76,7 @@ void entry(unsigned long magic, unsigned long addr) {
         module_t* mod = (module_t*)mbi->mods_addr;
         while (mod_count < mbi->mods_count) {
              fs_base_address = mod->mod_start;	// starting address of filesystem
+             fs_end_address = mod->mod_end;
             printf("Module %d loaded at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_start);
             printf("Module %d ends at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_end);
             printf("First few bytes of module:\n");
@@ -161,6 +172,11 @@ void entry(unsigned long magic, unsigned long addr) {
 
     page_directory_init();
 
+    // processes get their memory from here
+    frame_init(mem_top, fs_end_address);
+    kmalloc_init();
+    pid_init();
+
     filesys_init(fs_base_address);
 
     init_terminal();
@@ -169,6 +185,8 @@ void entry(unsigned long magic, unsigned long addr) {
 
     clear();
 
+    sched_init();
+
     sti();
 
     //terminal_open(NULL);
@@ -178,6 +196,6 @@ void entry(unsigned long magic, unsigned long addr) {
     //launch_tests();
 #endif
 
-    /* Spin (nicely, so we don't chew up cycles) */
-    asm volatile (".1: hlt; jmp .1;");
+    /* Become the idle task (halts, so we don't chew up cycles) */
+    sched_idle();
 }
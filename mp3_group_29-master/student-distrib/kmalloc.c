@@ -0,0 +1,234 @@
+#include "kmalloc.h"
+#include "frame.h"
+
+#define SLAB_MAGIC          0x51AB51AB
+
+/* Header at the start of every frame the heap owns. Objects of a size
+ * class follow it; a large allocation is the rest of its frames. kfree
+ * finds it by rounding the pointer down to the frame. */
+typedef struct slab {
+    uint32_t magic;
+    struct kmem_cache* cache;   // NULL for a large allocation
+    struct slab* next;          // slabs of the cache with free objects
+    struct slab* prev;
+    void* free;                 // free objects, linked through their first word
+    uint32_t in_use;
+    uint32_t pages;             // large allocation: frames
+} slab_t;
+
+/* Objects start this far into a slab, which keeps them 16 byte aligned. */
+#define SLAB_HEADER         ((sizeof(slab_t) + KMALLOC_MIN_SIZE - 1) & ~(KMALLOC_MIN_SIZE - 1))
+
+typedef struct kmem_cache {
+    uint32_t object_size;
+    uint32_t per_slab;          // objects a slab has room for
+    slab_t* partial;            // slabs with free objects
+    kmalloc_stats_t stats;
+} kmem_cache_t;
+
+static kmem_cache_t caches[KMALLOC_CACHES];
+static kmalloc_stats_t large_stats;
+
+void kmalloc_init(void) {
+    uint32_t i;
+
+    for (i = 0; i < KMALLOC_CACHES; i++) {
+        caches[i].object_size = KMALLOC_MIN_SIZE << i;
+        caches[i].per_slab = (FOUR_KB_SIZE - SLAB_HEADER) / caches[i].object_size;
+        caches[i].partial = NULL;
+        memset(&caches[i].stats, 0, sizeof(kmalloc_stats_t));
+        caches[i].stats.object_size = caches[i].object_size;
+    }
+
+    memset(&large_stats, 0, sizeof(kmalloc_stats_t));
+}
+
+/*
+ * DESCRIPTION: Gives a size class a new slab, every object free.
+ *
+ * INPUTS: cache -- size class
+ *
+ * OUTPUTS: the slab, NULL if memory is full
+ *
+ * SIDE EFFECTS: allocates a frame, puts the slab on the partial list
+ */
+static slab_t* slab_grow(kmem_cache_t* cache) {
+    slab_t* slab = (slab_t *)frame_alloc();
+    uint8_t* obj;
+    uint32_t i;
+
+    if (!slab) return NULL;
+
+    slab->magic = SLAB_MAGIC;
+    slab->cache = cache;
+    slab->in_use = 0;
+    slab->free = NULL;
+
+    // thread the free list so objects are handed out in address order
+    obj = (uint8_t *)slab + SLAB_HEADER + (cache->per_slab - 1) * cache->object_size;
+    for (i = 0; i < cache->per_slab; i++, obj -= cache->object_size) {
+        *(void **)obj = slab->free;
+        slab->free = obj;
+    }
+
+    slab->prev = NULL;
+    slab->next = cache->partial;
+    if (cache->partial) cache->partial->prev = slab;
+    cache->partial = slab;
+
+    cache->stats.slabs++;
+    cache->stats.objects += cache->per_slab;
+
+    return slab;
+}
+
+static void slab_unlink(kmem_cache_t* cache, slab_t* slab) {
+    if (slab->prev) slab->prev->next = slab->next;
+    else cache->partial = slab->next;
+    if (slab->next) slab->next->prev = slab->prev;
+}
+
+/*
+ * DESCRIPTION: Allocates kernel memory. Sizes up to KMALLOC_MAX_SIZE come
+ * from the smallest size class they fit, bigger ones get contiguous
+ * frames of their own.
+ *
+ * INPUTS: size -- bytes wanted
+ *
+ * OUTPUTS: pointer to the memory, NULL if size is 0 or memory is full
+ *
+ * SIDE EFFECTS: may allocate frames, updates the statistics
+ */
+void* kmalloc(uint32_t size) {
+    kmem_cache_t* cache;
+    slab_t* slab;
+    void* obj;
+    uint32_t i, pages, flags;
+
+    if (size == 0) return NULL;
+
+    cli_and_save(flags);
+
+    if (size > KMALLOC_MAX_SIZE) {
+        slab = NULL;
+        if (size < USER_MEM) {
+            pages = (size + SLAB_HEADER + FOUR_KB_SIZE - 1) / FOUR_KB_SIZE;
+            slab = (slab_t *)frame_alloc_contig(pages, 1);
+        }
+        if (!slab) {
+            large_stats.failures++;
+            restore_flags(flags);
+            return NULL;
+        }
+
+        slab->magic = SLAB_MAGIC;
+        slab->cache = NULL;
+        slab->pages = pages;
+
+        large_stats.slabs += pages;
+        large_stats.objects++;
+        large_stats.in_use++;
+        large_stats.bytes += size;
+        large_stats.allocs++;
+
+        restore_flags(flags);
+        return (uint8_t *)slab + SLAB_HEADER;
+    }
+
+    for (i = 0; (KMALLOC_MIN_SIZE << i) < size; i++);
+    cache = &caches[i];
+
+    slab = cache->partial;
+    if (!slab && !(slab = slab_grow(cache))) {
+        cache->stats.failures++;
+        restore_flags(flags);
+        return NULL;
+    }
+
+    obj = slab->free;
+    slab->free = *(void **)obj;
+    slab->in_use++;
+
+    // full slabs leave the partial list until something is freed
+    if (slab->in_use == cache->per_slab) slab_unlink(cache, slab);
+
+    cache->stats.in_use++;
+    cache->stats.bytes += size;
+    cache->stats.allocs++;
+
+    restore_flags(flags);
+    return obj;
+}
+
+/*
+ * DESCRIPTION: Frees memory from kmalloc. A slab left with no objects in
+ * use goes back to the frame allocator.
+ *
+ * INPUTS: ptr -- memory from kmalloc, or NULL
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: may free frames, updates the statistics
+ */
+void kfree(void* ptr) {
+    slab_t* slab = (slab_t *)((uint32_t)ptr & ~(FOUR_KB_SIZE - 1));
+    kmem_cache_t* cache;
+    uint32_t flags;
+
+    if (ptr == NULL || slab->magic != SLAB_MAGIC) return;
+
+    cli_and_save(flags);
+
+    cache = slab->cache;
+
+    if (cache == NULL) {
+        large_stats.slabs -= slab->pages;
+        large_stats.objects--;
+        large_stats.in_use--;
+        large_stats.frees++;
+
+        slab->magic = 0;
+        frame_free_contig((uint32_t)slab, slab->pages);
+
+        restore_flags(flags);
+        return;
+    }
+
+    // a full slab has room again
+    if (slab->in_use == cache->per_slab) {
+        slab->prev = NULL;
+        slab->next = cache->partial;
+        if (cache->partial) cache->partial->prev = slab;
+        cache->partial = slab;
+    }
+
+    *(void **)ptr = slab->free;
+    slab->free = ptr;
+    slab->in_use--;
+
+    cache->stats.in_use--;
+    cache->stats.frees++;
+
+    if (slab->in_use == 0) {
+        slab_unlink(cache, slab);
+        slab->magic = 0;
+        frame_free((uint32_t)slab);
+
+        cache->stats.slabs--;
+        cache->stats.objects -= cache->per_slab;
+    }
+
+    restore_flags(flags);
+}
+
+int32_t kmalloc_stats(uint32_t cache, kmalloc_stats_t* stats) {
+    uint32_t flags;
+
+    if (cache > KMALLOC_LARGE || stats == NULL) return -1;
+
+    cli_and_save(flags);
+    *stats = (cache == KMALLOC_LARGE) ? large_stats : caches[cache].stats;
+    restore_flags(flags);
+
+    return 0;
+}
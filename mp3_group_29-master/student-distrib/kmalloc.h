@@ -0,0 +1,46 @@
+/*
+ * kmalloc.h - Kernel heap: slab caches of small objects over the frame
+ * allocator.
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _KMALLOC_H
+#define _KMALLOC_H
+
+#include "types.h"
+#include "lib.h"
+
+#define KMALLOC_MIN_SIZE    16      // smallest size class
+#define KMALLOC_CACHES      7       // size classes 16, 32, ... 1024
+#define KMALLOC_MAX_SIZE    (KMALLOC_MIN_SIZE << (KMALLOC_CACHES - 1))
+
+/* kmalloc_stats index for allocations over KMALLOC_MAX_SIZE, which get
+ * whole frames of their own. */
+#define KMALLOC_LARGE       KMALLOC_CACHES
+
+typedef struct kmalloc_stats {
+    uint32_t object_size;   // size class, 0 for the large allocations
+    uint32_t slabs;         // frames the cache holds
+    uint32_t objects;       // objects those frames have room for
+    uint32_t in_use;        // objects allocated
+    uint32_t allocs;        // kmalloc calls served
+    uint32_t bytes;         // bytes those calls asked for
+    uint32_t frees;
+    uint32_t failures;      // kmalloc calls that found no memory
+} kmalloc_stats_t;
+
+/* Sets up the size classes. Needs frame_init first. */
+void kmalloc_init(void);
+
+/* Returns size bytes of kernel memory (16 byte aligned), NULL if there
+ * is none. kfree gives it back; kfree(NULL) does nothing. */
+void* kmalloc(uint32_t size);
+void kfree(void* ptr);
+
+/* Copies the counters of a size class (or KMALLOC_LARGE). Returns -1 for
+ * a bad index. objects - in_use is room the slabs hold but nobody uses;
+ * object_size - bytes / allocs is what rounding up to the size class
+ * wastes per object. */
+int32_t kmalloc_stats(uint32_t cache, kmalloc_stats_t* stats);
+
+#endif /* _KMALLOC_H */
@@ -106,6 +106,18 @@ do {                                    \
     );                                  \
 } while (0)
 
+/* Reads the low 32 bits of the time stamp counter (CPU cycles) --
+ * enough for timing anything shorter than a second */
+static inline uint32_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc"
+            : "=a"(lo), "=d"(hi)
+            :
+            : "memory"
+    );
+    return lo;
+}
+
 /* Clear interrupt flag - disables interrupts on this processor */
 #define cli()                           \
 do {                                    \
@@ -0,0 +1,44 @@
+#include "lz.h"
+
+/*
+ * DESCRIPTION: Decompresses an LZSS stream (see lz.h).
+ *
+ * INPUTS: src -- compressed data, src_len -- its length, dst -- output
+ * buffer, dst_len -- bytes to produce
+ *
+ * OUTPUTS: dst_len upon success, -1 if the stream is corrupt or ends early
+ *
+ * SIDE EFFECTS: fills dst
+ */
+int32_t lz_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len) {
+    uint32_t in = 0, out = 0;
+    uint32_t distance, length, bit;
+    uint8_t control;
+
+    while (out < dst_len) {
+        if (in >= src_len) return -1;
+        control = src[in++];
+
+        for (bit = 0; bit < 8 && out < dst_len; bit++, control >>= 1) {
+            // literal
+            if (control & 1) {
+                if (in >= src_len) return -1;
+                dst[out++] = src[in++];
+                continue;
+            }
+
+            // match
+            if (in + 2 > src_len) return -1;
+            distance = (src[in] | ((src[in + 1] & 0xF0) << 4)) + 1;
+            length = (src[in + 1] & 0x0F) + LZ_MIN_MATCH;
+            in += 2;
+
+            if (distance > out || length > dst_len - out) return -1;
+
+            // byte by byte -- a match may overlap what it produces
+            for (; length > 0; length--, out++) dst[out] = dst[out - distance];
+        }
+    }
+
+    return dst_len;
+}
@@ -0,0 +1,27 @@
+/*
+ * lz.h - LZSS decompression for compressed filesystem files.
+ * vim:ts=4 noexpandtab
+ *
+ * A compressed stream is a series of groups: a control byte, then eight
+ * items, one per control bit (lowest first). A 1 bit is a literal byte,
+ * a 0 bit a 2 byte match copying LZ_MIN_MATCH to LZ_MAX_MATCH bytes from
+ * 1 to LZ_WINDOW bytes back:
+ *
+ *     byte 0 -- low 8 bits of (distance - 1)
+ *     byte 1 -- high 4 bits of (distance - 1) << 4 | (length - LZ_MIN_MATCH)
+ */
+
+#ifndef _LZ_H
+#define _LZ_H
+
+#include "types.h"
+
+#define LZ_WINDOW       4096
+#define LZ_MIN_MATCH    3
+#define LZ_MAX_MATCH    (LZ_MIN_MATCH + 15)
+
+/* Decompresses src into exactly dst_len bytes of dst. Returns dst_len,
+ * or -1 if src is corrupt or too short. */
+int32_t lz_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len);
+
+#endif /* _LZ_H */
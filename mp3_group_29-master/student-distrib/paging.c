@@ -1,4 +1,7 @@
 #include "paging.h"
+#include "lib.h"
+#include "frame.h"
+#include "filesys.h"
 
 // static uint32_t var_cr0, var_cr4;
 
@@ -28,10 +31,12 @@ void page_directory_init(){
     }
     //initialize directory
 
-    page_table[VIDEO_INDEX] |= USER | PRESENT;
-    page_table[VIDEO_INDEX + 1] |= USER | PRESENT; // additional terminals
-    page_table[VIDEO_INDEX + 2] |= USER | PRESENT;
-    page_table[VIDEO_INDEX + 3] |= USER | PRESENT;
+    // the kernel half of the address space is the same for every process,
+    // so it is global -- remaps have to use flushTlbEntry
+    page_table[VIDEO_INDEX] |= USER | PRESENT | GLOBAL;
+    page_table[VIDEO_INDEX + 1] |= USER | PRESENT | GLOBAL; // additional terminals
+    page_table[VIDEO_INDEX + 2] |= USER | PRESENT | GLOBAL;
+    page_table[VIDEO_INDEX + 3] |= USER | PRESENT | GLOBAL;
 
     //linking page table to page directory
     
@@ -39,7 +44,7 @@ void page_directory_init(){
 
     //linking 4mb page to page directory
     
-    page_directory[1] = FOUR_MB_SIZE | SIZE | READ_WRITE | PRESENT;
+    page_directory[1] = FOUR_MB_SIZE | SIZE | READ_WRITE | PRESENT | GLOBAL;
 
     //turn on 4 mb pages
     setPD(page_directory);
@@ -50,7 +55,7 @@ void page_directory_init(){
 /*
  * DESCRIPTION: Initializes user page directory entry.
  *
- * INPUTS: addr - starting address 
+ * INPUTS: addr - physical address of the process' user page table
  * 
  * OUTPUTS: none
  * 
@@ -62,7 +67,7 @@ void switch_pd(uint32_t addr) {
 
 
     // 0x7 --> 111, USER | READ WRITE | PRESENT
-    page_directory[USER_PAGE] = addr | SIZE | USER | READ_WRITE | PRESENT;
+    page_directory[USER_PAGE] = addr | USER | READ_WRITE | PRESENT;
 
     // flushes TLB
     flushTlb();
@@ -92,15 +97,9 @@ void switch_vid() {
     if (exec_terminal == disp_terminal) page_table[0] = ((uint32_t)VIDEO_ADDRESS) | 0x07;
     else page_table[0] = ((uint32_t)(VIDEO_ADDRESS + (exec_terminal + 1)*FOUR_KB_SIZE )) | 0x07;
 
-    // flushes TLB
-    asm volatile (
-        "movl %%cr3, %%eax    \n"
-        "movl %%eax, %%cr3    \n"
-        :
-        : 
-        : "memory", "cc"
-
-    );
+    // flushes the two remapped entries (132 MB and the page_table[0] alias)
+    flushTlbEntry(VIDEO_END);
+    flushTlbEntry(0);
 
 }
 
@@ -117,13 +116,13 @@ void switch_vid() {
 void set_vidmem(int32_t terminal_num) {
     if(disp_terminal == exec_terminal)
 
-        page_table[VIDEO_INDEX] = ((uint32_t)VIDEO_ADDRESS) | USER | READ_WRITE | PRESENT;
+        page_table[VIDEO_INDEX] = ((uint32_t)VIDEO_ADDRESS) | USER | READ_WRITE | PRESENT | GLOBAL;
 
     else
 
-        page_table[VIDEO_INDEX] = ((uint32_t)(VIDEO_ADDRESS + (terminal_num+1)* FOUR_KB_SIZE )) | USER | READ_WRITE | PRESENT;
+        page_table[VIDEO_INDEX] = ((uint32_t)(VIDEO_ADDRESS + (terminal_num+1)* FOUR_KB_SIZE )) | USER | READ_WRITE | PRESENT | GLOBAL;
 
-    flushTlb();   
+    flushTlbEntry(VIDEO_ADDRESS);
 }
 
 /*
@@ -137,8 +136,8 @@ void set_vidmem(int32_t terminal_num) {
  *
  */
 void restore_vidmem(void) {
-    page_table[VIDEO_INDEX] = ((uint32_t)VIDEO_ADDRESS) | USER | READ_WRITE | PRESENT;
-    flushTlb();
+    page_table[VIDEO_INDEX] = ((uint32_t)VIDEO_ADDRESS) | USER | READ_WRITE | PRESENT | GLOBAL;
+    flushTlbEntry(VIDEO_ADDRESS);
 }
 
 /*
@@ -161,19 +160,493 @@ void flushTlb() {
     );
 }
 
-/* remap_program
- * Inputs: PID number of process
- * Return Value: void
- * Function: Initialises page for user program
+/*
+ * DESCRIPTION: flushes the tlb entry of a single page. Unlike flushTlb,
+ * this also works for global pages and leaves every other entry cached.
+ *
+ * INPUTS: addr - any virtual address in the page
+ * 
+ * OUTPUTS:
+ * 
+ * SIDE EFFECTS: flushes one tlb entry
+ * 
+ */
+void flushTlbEntry(uint32_t addr) {
+    asm volatile(
+        "invlpg (%0)"
+        :
+        : "r"(addr)
+        : "memory"
+    );
+}
+
+/*
+ * DESCRIPTION: Maps physical memory from 8MB up to mem_top into kernel
+ * space at the same address, using 4MB supervisor pages. This is where
+ * the frame allocator hands out PCBs, kernel stacks and program pages.
+ *
+ * INPUTS: mem_top -- end of physical RAM (at most 128MB)
+ * 
+ * OUTPUTS: none
+ * 
+ * SIDE EFFECTS: fills kernel page directory entries below the user page
+ * 
+ */
+void map_physical_memory(uint32_t mem_top) {
+    uint32_t i;
+
+    for (i = EIGHT_MB_SIZE / FOUR_MB_SIZE; i < USER_PAGE && i * FOUR_MB_SIZE < mem_top; i++)
+        page_directory[i] = (i * FOUR_MB_SIZE) | SIZE | READ_WRITE | PRESENT | GLOBAL;
+
+    flushTlb();
+}
+
+/*
+ * DESCRIPTION: Lets go of the page behind a user page table entry: a
+ * filesystem block's mapping count drops, the process' own frame is
+ * freed (or loses a reference).
+ *
+ * INPUTS: entry - present page table entry
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: may free a frame
+ *
+ */
+static void user_page_release(uint32_t entry) {
+    if (entry & PTE_SHARED) fs_block_unmap(entry & ~(FOUR_KB_SIZE - 1));
+    else frame_free(entry & ~(FOUR_KB_SIZE - 1));
+}
+
+/*
+ * DESCRIPTION: Allocates an empty page table for a process' 4MB user
+ * region at 128MB.
+ *
+ * INPUTS: none
+ * 
+ * OUTPUTS: physical address of the table, 0 if out of memory
+ * 
+ * SIDE EFFECTS: allocates a frame
+ * 
+ */
+uint32_t user_pt_create(void) {
+    uint32_t pt = frame_alloc();
+
+    if (pt) memset((void *)pt, 0, FOUR_KB_SIZE);
+
+    return pt;
+}
+
+/*
+ * DESCRIPTION: Backs one page of a user page table with a zeroed 4KB frame.
+ *
+ * INPUTS: pt - user page table, va - virtual address inside the 4MB user
+ * region
+ * 
+ * OUTPUTS: physical (and kernel) address of the frame, 0 if out of memory,
+ * the address is invalid or already mapped
+ * 
+ * SIDE EFFECTS: allocates a frame
+ * 
+ */
+uint32_t user_map_page(uint32_t pt, uint32_t va) {
+    uint32_t* table = (uint32_t *)pt;
+    uint32_t idx = (va - USER_MEM) / FOUR_KB_SIZE;
+    uint32_t frame;
+
+    if (va < USER_MEM || idx >= table_entries || (table[idx] & PRESENT)) return 0;
+
+    frame = frame_alloc();
+    if (!frame) return 0;
+
+    memset((void *)frame, 0, FOUR_KB_SIZE);
+    table[idx] = frame | USER | READ_WRITE | PRESENT;
+
+    return frame;
+}
+
+/*
+ * DESCRIPTION: Maps a page the process doesn't own (e.g. a filesystem
+ * block) read-only into a user page table.
+ *
+ * INPUTS: pt - user page table, va - virtual address inside the 4MB user
+ * region, addr - page aligned physical address to map
+ * 
+ * OUTPUTS: 0 upon success, -1 if va is invalid or already mapped
+ * 
+ * SIDE EFFECTS: counts the block's mapping (fs_block_map), the page is
+ * never freed by user_pt_destroy
+ * 
+ */
+int32_t user_map_shared(uint32_t pt, uint32_t va, uint32_t addr) {
+    uint32_t* table = (uint32_t *)pt;
+    uint32_t idx = (va - USER_MEM) / FOUR_KB_SIZE;
+
+    if (va < USER_MEM || idx >= table_entries || (table[idx] & PRESENT)) return -1;
+
+    table[idx] = addr | PTE_SHARED | USER | PRESENT;
+    fs_block_map(addr);
+
+    return 0;
+}
+
+/*
+ * DESCRIPTION: Maps frames shared with other processes (shared memory)
+ * writable into a user page table, taking a reference to each.
+ *
+ * INPUTS: pt - user page table, va - page aligned start of the mapping
+ * inside the 4MB user region, frames - physical addresses of the
+ * frames, count - number of frames
+ *
+ * OUTPUTS: 0 upon success, -1 if a page is invalid or already mapped
+ * (nothing is mapped then)
+ *
+ * SIDE EFFECTS: takes frame references
+ *
+ */
+int32_t user_map_frames(uint32_t pt, uint32_t va, const uint32_t* frames, uint32_t count) {
+    uint32_t* table = (uint32_t *)pt;
+    uint32_t idx = (va - USER_MEM) / FOUR_KB_SIZE;
+    uint32_t i;
+
+    if (va < USER_MEM || idx + count > table_entries) return -1;
+
+    for (i = 0; i < count; i++) {
+        if (table[idx + i] & PRESENT) return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        frame_ref(frames[i]);
+        table[idx + i] = frames[i] | PTE_SHM | USER | READ_WRITE | PRESENT;
+    }
+
+    return 0;
+}
+
+/*
+ * DESCRIPTION: Maps a whole file read-only into a user page table, each
+ * page straight onto its filesystem block. If the blocks can't be mapped
+ * (image not page aligned) the page is a read-only copy instead. Either
+ * way a write gives the process its own copy, never touching the file.
+ *
+ * INPUTS: pt - user page table, va - page aligned start of the mapping
+ * inside the 4MB user region, inode - file's inode, length - file size
+ *
+ * OUTPUTS: 0 upon success, -1 if a page is already mapped or out of
+ * memory (nothing is left mapped)
+ *
+ * SIDE EFFECTS: may allocate frames
+ *
+ */
+int32_t user_map_file(uint32_t pt, uint32_t va, uint32_t inode, uint32_t length) {
+    uint32_t* table = (uint32_t *)pt;
+    uint32_t idx = (va - USER_MEM) / FOUR_KB_SIZE;
+    uint32_t offset, block, frame, count;
+
+    for (offset = 0; offset < length; offset += FOUR_KB_SIZE, idx++) {
+        block = file_block_addr(inode, offset);
+
+        if (block && user_map_shared(pt, va + offset, block) == 0) continue;
+
+        if (!block && (frame = user_map_page(pt, va + offset))) {
+            count = length - offset;
+            if (count > FOUR_KB_SIZE) count = FOUR_KB_SIZE;
+            read_data(inode, offset, (uint8_t *)frame, count);
+
+            // read-only until written, like the shared blocks
+            table[idx] = frame | PTE_COW | USER | PRESENT;
+            continue;
+        }
+
+        // undo the pages mapped so far
+        while (offset > 0) {
+            offset -= FOUR_KB_SIZE;
+            idx--;
+            user_page_release(table[idx]);
+            table[idx] = 0;
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * DESCRIPTION: Gives the process a private, writable copy of a shared or
+ * copy-on-write page. A copy-on-write frame nobody else uses any more is
+ * just made writable again.
+ *
+ * INPUTS: pt - user page table, va - address inside the shared page
+ * 
+ * OUTPUTS: 0 upon success, -1 if the page isn't shared or out of memory
+ * 
+ * SIDE EFFECTS: may allocate a frame, flushes the page's TLB entry
+ * 
+ */
+int32_t user_cow_page(uint32_t pt, uint32_t va) {
+    uint32_t* table = (uint32_t *)pt;
+    uint32_t idx = (va - USER_MEM) / FOUR_KB_SIZE;
+    uint32_t old, frame;
+
+    if (va < USER_MEM || idx >= table_entries) return -1;
+    if (!(table[idx] & PRESENT) || !(table[idx] & (PTE_SHARED | PTE_COW))) return -1;
+
+    old = table[idx] & ~(FOUR_KB_SIZE - 1);
+
+    if ((table[idx] & PTE_COW) && frame_refcount(old) == 1) {
+        table[idx] = old | USER | READ_WRITE | PRESENT;
+        flushTlbEntry(va);
+        return 0;
+    }
+
+    frame = frame_alloc();
+    if (!frame) return -1;
+
+    memcpy((void *)frame, (void *)old, FOUR_KB_SIZE);
+
+    // drop our reference to a copy-on-write frame or filesystem block
+    user_page_release(table[idx]);
+
+    table[idx] = frame | USER | READ_WRITE | PRESENT;
+
+    flushTlbEntry(va);
+
+    return 0;
+}
+
+/*
+ * DESCRIPTION: Takes the frame behind a page of the running process so
+ * it can be handed to another one (pipe splice) without copying. The
+ * process is left with a zeroed page in its place. Pages it doesn't own
+ * outright (filesystem blocks, shared memory) stay as they are and a
+ * copy is taken instead.
+ *
+ * INPUTS: pt - the running process' page table, va - address inside the
+ * page
+ *
+ * OUTPUTS: the frame (one reference, the caller's now), 0 if the address
+ * is invalid or out of memory
+ *
+ * SIDE EFFECTS: may page in and allocate frames, flushes the page's TLB
+ * entry
+ *
+ */
+uint32_t user_page_take(uint32_t pt, uint32_t va) {
+    uint32_t* table = (uint32_t *)pt;
+    uint32_t idx = (va - USER_MEM) / FOUR_KB_SIZE;
+    uint32_t old, frame;
+
+    if (va < USER_MEM || idx >= table_entries) return 0;
+
+    // never touched yet -- page it in like the process would
+    if (!(table[idx] & PRESENT) && handle_page_fault(va, PF_USER)) return 0;
+
+    old = table[idx] & ~(FOUR_KB_SIZE - 1);
+
+    frame = frame_alloc();
+    if (!frame) return 0;
+
+    if (table[idx] & (PTE_SHARED | PTE_SHM)) {
+        memcpy((void *)frame, (void *)old, FOUR_KB_SIZE);
+        return frame;
+    }
+
+    // our reference to a copy-on-write frame goes with it
+    memset((void *)frame, 0, FOUR_KB_SIZE);
+    table[idx] = frame | USER | READ_WRITE | PRESENT;
+
+    flushTlbEntry(va);
+
+    return old;
+}
+
+/*
+ * DESCRIPTION: Maps a frame from user_page_take into a user page table,
+ * replacing whatever is mapped there. It is mapped copy-on-write, so it
+ * only becomes writable without a copy if nobody else holds it.
+ *
+ * INPUTS: pt - user page table, va - page aligned address inside the 4MB
+ * user region, frame - frame to map, with the reference that goes into
+ * the table
+ *
+ * OUTPUTS: 0 upon success, -1 if va is invalid or shared memory
+ *
+ * SIDE EFFECTS: frees (or drops a reference to) the frame replaced,
+ * flushes the page's TLB entry
+ *
+ */
+int32_t user_page_give(uint32_t pt, uint32_t va, uint32_t frame) {
+    uint32_t* table = (uint32_t *)pt;
+    uint32_t idx = (va - USER_MEM) / FOUR_KB_SIZE;
+
+    if (va < USER_MEM || idx >= table_entries || (table[idx] & PTE_SHM)) return -1;
+
+    if (table[idx] & PRESENT) user_page_release(table[idx]);
+
+    table[idx] = frame | PTE_COW | USER | PRESENT;
+
+    flushTlbEntry(va);
+
+    return 0;
+}
+
+/*
+ * DESCRIPTION: Unmaps the pages of a range of the current process'
+ * address space, e.g. heap given back with sbrk.
+ *
+ * INPUTS: pt - user page table, start - first page, end - page aligned
+ * end of the range
+ * 
+ * OUTPUTS: none
+ * 
+ * SIDE EFFECTS: frees (or drops references to) the frames, flushes
+ * their TLB entries
+ * 
+ */
+void user_unmap_range(uint32_t pt, uint32_t start, uint32_t end) {
+    uint32_t* table = (uint32_t *)pt;
+    uint32_t va, idx;
+
+    for (va = start; va < end; va += FOUR_KB_SIZE) {
+        idx = (va - USER_MEM) / FOUR_KB_SIZE;
+        if (va < USER_MEM || idx >= table_entries || !(table[idx] & PRESENT)) continue;
+
+        user_page_release(table[idx]);
+        table[idx] = 0;
+        flushTlbEntry(va);
+    }
+}
+
+/*
+ * DESCRIPTION: Makes a copy-on-write duplicate of a user address space
+ * (fork). Both page tables end up pointing at the same frames read-only;
+ * the first write to a page gives the writer its own copy. Shared memory
+ * is mapped writable in both.
+ *
+ * INPUTS: pt - user page table to duplicate
+ * 
+ * OUTPUTS: physical address of the new table, 0 if out of memory
+ * 
+ * SIDE EFFECTS: write-protects pt's private pages, takes frame references,
+ * flushes the TLB
+ * 
  */
-void remap_program(uint32_t pid){
+uint32_t user_pt_clone(uint32_t pt) {
+    uint32_t* table = (uint32_t *)pt;
+    uint32_t* copy;
+    uint32_t new_pt;
+    int i;
 
-    uint32_t addr = EIGHT_MB_SIZE + pid * FOUR_MB_SIZE;
+    new_pt = user_pt_create();
+    if (!new_pt) return 0;
 
-    // 32 = 128MB virtual 
-    page_directory[32] =  addr | SIZE | USER | READ_WRITE | PRESENT;
+    copy = (uint32_t *)new_pt;
+
+    for (i = 0; i < table_entries; i++) {
+        if (!(table[i] & PRESENT)) continue;
+
+        // shared memory stays shared, and writable
+        if (table[i] & PTE_SHM) frame_ref(table[i] & ~(FOUR_KB_SIZE - 1));
+        else if (table[i] & PTE_SHARED) fs_block_map(table[i] & ~(FOUR_KB_SIZE - 1));
+        else {
+            table[i] = (table[i] & ~READ_WRITE) | PTE_COW;
+            frame_ref(table[i] & ~(FOUR_KB_SIZE - 1));
+        }
+
+        copy[i] = table[i];
+    }
 
-    // flush TLB
     flushTlb();
-    return;
+
+    return new_pt;
+}
+
+/*
+ * DESCRIPTION: Resolves a page fault by demand paging. A non-present page
+ * of the running process' image is mapped straight onto its filesystem
+ * block when a whole block backs it, otherwise filled from the
+ * filesystem; one on its heap or stack is zero-filled. Writes to a
+ * shared page get a private copy.
+ *
+ * INPUTS: addr - faulting address (cr2), error - error code from the CPU
+ * 
+ * OUTPUTS: 0 if the page was mapped, -1 if the access is invalid
+ * 
+ * SIDE EFFECTS: allocates and maps a frame in the current page table
+ * 
+ */
+int32_t handle_page_fault(uint32_t addr, uint32_t error) {
+    uint32_t va = addr & ~(FOUR_KB_SIZE - 1);
+    uint32_t frame, offset, count;
+
+    // nothing to page in outside a process
+    if (!curr_pcb) return -1;
+
+    // the only legal protection violation is a write to a shared or
+    // copy-on-write page
+    if (error & PF_PRESENT) {
+        if (!(error & PF_WRITE)) return -1;
+        return user_cow_page(curr_pcb->page_table, va);
+    }
+
+    if (va >= USER_PROGRAM_ADDR && va < curr_pcb->image_end) {
+        // the image is the file laid out from USER_PROGRAM_ADDR
+        offset = va - USER_PROGRAM_ADDR;
+
+        // whole page is file data -- share the block, no copy
+        if (offset + FOUR_KB_SIZE <= curr_pcb->image_length) {
+            frame = file_block_addr(curr_pcb->image_inode, offset);
+            if (frame) return user_map_shared(curr_pcb->page_table, va, frame);
+        }
+
+        frame = user_map_page(curr_pcb->page_table, va);
+        if (!frame) return -1;
+
+        if (offset < curr_pcb->image_length) {
+            count = curr_pcb->image_length - offset;
+            if (count > FOUR_KB_SIZE) count = FOUR_KB_SIZE;
+            read_data(curr_pcb->image_inode, offset, (uint8_t *)frame, count);
+        }
+    }
+    else if (va >= curr_pcb->heap_start && va < curr_pcb->brk) {
+        // heap grown with sbrk, zero-filled like the stack
+        if (!user_map_page(curr_pcb->page_table, va)) return -1;
+    }
+    else if (va >= USER_STACK_TOP - USER_STACK_MAX && va < USER_STACK_TOP) {
+        if (!user_map_page(curr_pcb->page_table, va)) return -1;
+    }
+    else return -1;
+
+    return 0;
+}
+
+/*
+ * DESCRIPTION: Frees a user page table and every frame mapped in it.
+ *
+ * INPUTS: pt - user page table from user_pt_create
+ * 
+ * OUTPUTS: none
+ * 
+ * SIDE EFFECTS: frees frames
+ * 
+ */
+void user_pt_destroy(uint32_t pt) {
+    uint32_t* table = (uint32_t *)pt;
+    int i;
+
+    if (!pt) return;
+
+    // shared pages belong to the filesystem, copy-on-write ones may still
+    // be used by a forked process (frame_free only drops our reference)
+    for (i = 0; i < table_entries; i++) {
+        if (table[i] & PRESENT) user_page_release(table[i]);
+    }
+
+    // don't leave the page directory pointing at a freed table
+    if ((page_directory[USER_PAGE] & ~(FOUR_KB_SIZE - 1)) == pt) {
+        page_directory[USER_PAGE] = 0;
+        flushTlb();
+    }
+
+    frame_free(pt);
 }
@@ -3,6 +3,23 @@
 
 #include "types.h"
 
+// page fault error code bits
+#define PF_PRESENT  0x1     // fault on a present page (protection violation)
+#define PF_WRITE    0x2     // fault was a write
+#define PF_USER     0x4     // fault happened in user mode
+
+// available page table entry bit -- the frame is not the process' own
+// (e.g. a filesystem block), it is mapped read-only and copied on write
+#define PTE_SHARED  0x200
+
+// available page table entry bit -- the process' own frame, shared with
+// a forked process (reference counted) until one of them writes it
+#define PTE_COW     0x400
+
+// available page table entry bit -- a shared memory frame, writable by
+// every process that maps it (reference counted), stays shared on fork
+#define PTE_SHM     0x800
+
 uint32_t page_table[table_entries]  __attribute__((aligned (FOUR_KB_SIZE)));
 
 uint32_t page_directory[table_entries]  __attribute__((aligned (FOUR_KB_SIZE)));
@@ -17,14 +34,30 @@ void enablePaging(void);
 
 // user program support
 extern void switch_pd(uint32_t addr);
+extern uint32_t user_pt_create(void);
+extern uint32_t user_map_page(uint32_t pt, uint32_t va);
+extern int32_t user_map_shared(uint32_t pt, uint32_t va, uint32_t addr);
+extern int32_t user_map_frames(uint32_t pt, uint32_t va, const uint32_t* frames, uint32_t count);
+extern int32_t user_map_file(uint32_t pt, uint32_t va, uint32_t inode, uint32_t length);
+extern int32_t user_cow_page(uint32_t pt, uint32_t va);
+extern uint32_t user_page_take(uint32_t pt, uint32_t va);
+extern int32_t user_page_give(uint32_t pt, uint32_t va, uint32_t frame);
+extern void user_unmap_range(uint32_t pt, uint32_t start, uint32_t end);
+extern uint32_t user_pt_clone(uint32_t pt);
+extern void user_pt_destroy(uint32_t pt);
 
 // multiterminal support
 extern void switch_vid();
 extern void set_vidmem(int32_t terminal_num);
 extern void restore_vidmem(void);
 
-extern void remap_program(uint32_t pid);
+// kernel access to allocatable memory
+extern void map_physical_memory(uint32_t mem_top);
 
 extern void flushTlb();
+extern void flushTlbEntry(uint32_t addr);
+
+// demand paging
+extern int32_t handle_page_fault(uint32_t addr, uint32_t error);
 
 #endif
@@ -0,0 +1,187 @@
+#include "pcache.h"
+#include "filesys.h"
+
+/* Pages of files as read_data returns them -- for a compressed file
+ * the decompressed data, so it is decoded once however it is read. */
+static datablock_t pcache_data[PCACHE_SIZE];
+
+typedef struct pcache_entry {
+    uint32_t inode;
+    uint32_t page;          // page of the file (offset / BLOCK_SIZE)
+    uint32_t length;        // bytes of the page in the file
+    uint32_t last_use;      // pcache_clock when last touched, for LRU
+    uint32_t valid;
+} pcache_entry_t;
+
+static pcache_entry_t pcache[PCACHE_SIZE];
+static uint32_t pcache_clock;
+
+/* A file being read, direct mapped by inode number. Reads that start
+ * where the last one ended are sequential and grow the read-ahead
+ * window, anything else shrinks it back to nothing. */
+typedef struct pcache_stream {
+    uint32_t inode;
+    uint32_t next;          // byte the next sequential read starts at
+    uint32_t ra_end;        // first page not read ahead yet
+    uint32_t window;        // pages to keep read ahead, 0 for random access
+    uint32_t valid;
+} pcache_stream_t;
+
+static pcache_stream_t pcache_streams[PCACHE_STREAMS];
+static pcache_stats_t pcache_counters;
+
+void pcache_init(void) {
+    uint32_t i;
+
+    for (i = 0; i < PCACHE_SIZE; i++) pcache[i].valid = 0;
+    for (i = 0; i < PCACHE_STREAMS; i++) pcache_streams[i].valid = 0;
+
+    pcache_clock = 0;
+    pcache_counters.hits = 0;
+    pcache_counters.misses = 0;
+    pcache_counters.readahead = 0;
+}
+
+/*
+ * DESCRIPTION: Finds a page in the cache, reading it in if it isn't
+ * there. Takes a free entry if there is one, otherwise the least
+ * recently used one.
+ *
+ * INPUTS: inode -- file, page -- page of the file, ahead -- page is
+ * being read ahead (only counted as read ahead, not as a hit or miss)
+ *
+ * OUTPUTS: entry index, PCACHE_SIZE if the page couldn't be read
+ *
+ * SIDE EFFECTS: may evict another page, updates the counters
+ */
+static uint32_t pcache_get(uint32_t inode, uint32_t page, int32_t ahead) {
+    uint32_t i, victim = 0;
+    int32_t length;
+
+    for (i = 0; i < PCACHE_SIZE; i++) {
+        if (pcache[i].valid && pcache[i].inode == inode && pcache[i].page == page) break;
+        if (pcache[victim].valid && (!pcache[i].valid || pcache[i].last_use < pcache[victim].last_use)) victim = i;
+    }
+
+    if (i < PCACHE_SIZE) {
+        if (!ahead) pcache_counters.hits++;
+    }
+    else {
+        i = victim;
+        pcache[i].valid = 0;
+
+        length = read_data(inode, page * BLOCK_SIZE, pcache_data[i].data, BLOCK_SIZE);
+        if (length <= 0) return PCACHE_SIZE;
+
+        pcache[i].inode = inode;
+        pcache[i].page = page;
+        pcache[i].length = length;
+        pcache[i].valid = 1;
+
+        if (ahead) pcache_counters.readahead++;
+        else pcache_counters.misses++;
+    }
+
+    pcache[i].last_use = ++pcache_clock;
+
+    return i;
+}
+
+/*
+ * DESCRIPTION: Reads from a file through the cache. A read that carries
+ * on where the file's last read ended counts as sequential: the window
+ * of pages read ahead of it doubles, up to PCACHE_MAX_READAHEAD, and is
+ * filled once the reader is past half of it, so a steady reader finds
+ * its pages already in the cache.
+ *
+ * INPUTS: inode -- file, offset -- byte to start at, buf -- buffer,
+ * length -- bytes to read
+ *
+ * OUTPUTS: bytes read, 0 at the end of the file, -1 on failure
+ *
+ * SIDE EFFECTS: fills buf, may read pages ahead and evict others
+ */
+int32_t pcache_read(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length) {
+    pcache_stream_t* st = &pcache_streams[inode % PCACHE_STREAMS];
+    uint32_t copied, count, in_page, size, page, last, i, flags;
+    int32_t ret = 0;
+
+    if (buf == NULL || inode >= boot_block->inode_nums) return -1;
+
+    size = get_file_size(inode);
+    if (offset >= size) return 0;
+    if (length > size - offset) length = size - offset;
+
+    cli_and_save(flags);
+
+    for (copied = 0; copied < length; copied += count) {
+        page = (offset + copied) / BLOCK_SIZE;
+        in_page = (offset + copied) % BLOCK_SIZE;
+
+        i = pcache_get(inode, page, 0);
+        if (i == PCACHE_SIZE || pcache[i].length <= in_page) {
+            ret = -1;
+            break;
+        }
+
+        count = pcache[i].length - in_page;
+        if (count > length - copied) count = length - copied;
+        memcpy(&buf[copied], &pcache_data[i].data[in_page], count);
+    }
+
+    if (ret == 0) {
+        // sequential?
+        if (st->valid && st->inode == inode && st->next == offset) {
+            st->window = st->window ? st->window * 2 : 2;
+            if (st->window > PCACHE_MAX_READAHEAD) st->window = PCACHE_MAX_READAHEAD;
+        }
+        else {
+            st->inode = inode;
+            st->ra_end = 0;
+            st->window = 0;
+            st->valid = 1;
+        }
+        st->next = offset + length;
+
+        // read ahead once the reader is halfway into what was read ahead
+        last = (st->next + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        if (st->window && last + st->window / 2 >= st->ra_end) {
+            if (st->ra_end < last) st->ra_end = last;
+            for (; st->ra_end < last + st->window && st->ra_end * BLOCK_SIZE < size; st->ra_end++) {
+                if (pcache_get(inode, st->ra_end, 1) == PCACHE_SIZE) break;
+            }
+        }
+
+        ret = length;
+    }
+
+    restore_flags(flags);
+
+    return ret;
+}
+
+void pcache_invalidate(uint32_t inode, uint32_t offset) {
+    uint32_t i, flags;
+
+    cli_and_save(flags);
+
+    for (i = 0; i < PCACHE_SIZE; i++) {
+        if (pcache[i].valid && pcache[i].inode == inode && (pcache[i].page + 1) * BLOCK_SIZE > offset)
+            pcache[i].valid = 0;
+    }
+
+    // pages read ahead past offset are gone
+    i = inode % PCACHE_STREAMS;
+    if (pcache_streams[i].inode == inode && pcache_streams[i].ra_end * BLOCK_SIZE > offset)
+        pcache_streams[i].ra_end = offset / BLOCK_SIZE;
+
+    restore_flags(flags);
+}
+
+void pcache_stats(pcache_stats_t* stats) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    *stats = pcache_counters;
+    restore_flags(flags);
+}
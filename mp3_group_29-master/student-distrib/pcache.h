@@ -0,0 +1,36 @@
+/*
+ * pcache.h - Page cache for file reads, with sequential read-ahead.
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _PCACHE_H
+#define _PCACHE_H
+
+#include "types.h"
+#include "lib.h"
+
+#define PCACHE_SIZE             32      // file pages cached at once
+#define PCACHE_STREAMS          8       // files whose access pattern is tracked
+#define PCACHE_MAX_READAHEAD    8       // pages read ahead of a sequential reader
+
+typedef struct pcache_stats {
+    uint32_t hits;          // pages found in the cache
+    uint32_t misses;        // pages a reader had to wait for
+    uint32_t readahead;     // pages read ahead
+} pcache_stats_t;
+
+/* Empties the cache and zeroes the counters. */
+void pcache_init(void);
+
+/* Reads from a file through the cache, like read_data. Returns bytes
+ * read, 0 at the end of the file, -1 on failure. */
+int32_t pcache_read(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
+
+/* Drops the cached pages of a file from offset on -- writers call it
+ * after changing the file. */
+void pcache_invalidate(uint32_t inode, uint32_t offset);
+
+/* Copies the hit/miss counters. */
+void pcache_stats(pcache_stats_t* stats);
+
+#endif /* _PCACHE_H */
@@ -0,0 +1,333 @@
+#include "pipe.h"
+#include "kmalloc.h"
+#include "frame.h"
+#include "paging.h"
+#include "scheduler.h"
+#include "syscall_help.h"
+
+/* Shared by every fd referring to either end. Freed when the last one
+ * is closed. Data is either bytes in the ring buffer or frames spliced
+ * in whole -- never both, so it comes out in the order it went in. */
+typedef struct pipe {
+    uint8_t* buf;               // PIPE_SIZE byte ring buffer (one frame)
+    uint32_t head;              // next byte to read
+    uint32_t count;             // bytes buffered
+    uint32_t pages[PIPE_PAGES]; // spliced frames, a ring like buf
+    uint32_t page_head;         // next frame to read
+    uint32_t npages;            // frames queued
+    uint32_t page_off;          // bytes of the first frame read already
+    uint32_t readers;           // fds on the read end
+    uint32_t writers;           // fds on the write end
+    wait_queue_t read_wait;     // readers waiting for data
+    wait_queue_t write_wait;    // writers waiting for room
+} pipe_t;
+
+static fop_t pipe_read_fop = {null_open, pipe_close, pipe_read, null_write};
+static fop_t pipe_write_fop = {null_open, pipe_close, null_read, pipe_write};
+
+#define PIPE_OF(fd)     ((pipe_t *)curr_pcb->open_files[fd].inode_num)
+
+/*
+ * DESCRIPTION: Drops the first spliced frame, which has been read or
+ * mapped by the reader.
+ *
+ * INPUTS: p -- pipe with a frame queued
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: none
+ */
+static void pipe_pop_page(pipe_t* p) {
+    p->page_head = (p->page_head + 1) % PIPE_PAGES;
+    p->npages--;
+    p->page_off = 0;
+}
+
+/*
+ * DESCRIPTION: Creates a pipe. The ends are two fds of the current
+ * process; fork, dup2 and stdin/stdout inheritance share them further.
+ *
+ * INPUTS: fds -- where the read and write fds go
+ *
+ * OUTPUTS: 0 upon success, -1 if the process has no two free fds or
+ * memory is full
+ *
+ * SIDE EFFECTS: allocates the pipe and its buffer
+ */
+int32_t pipe_create(int32_t* fds) {
+    int32_t ends[2], i, n;
+    pipe_t* p;
+
+    // lowest free fds, as open does
+    for (i = 2, n = 0; i < 8 && n < 2; i++) {
+        if (curr_pcb->open_files[i].flags != FLAG_BUSY) ends[n++] = i;
+    }
+    if (n < 2) return -1;
+
+    p = kmalloc(sizeof(pipe_t));
+    if (!p) return -1;
+
+    p->buf = (uint8_t *)frame_alloc();
+    if (!p->buf) {
+        kfree(p);
+        return -1;
+    }
+
+    p->head = 0;
+    p->count = 0;
+    p->page_head = 0;
+    p->npages = 0;
+    p->page_off = 0;
+    p->readers = 1;
+    p->writers = 1;
+    p->read_wait.head = p->read_wait.tail = NULL;
+    p->write_wait.head = p->write_wait.tail = NULL;
+
+    for (i = 0; i < 2; i++) {
+        curr_pcb->open_files[ends[i]].file_op_table = i ? pipe_write_fop : pipe_read_fop;
+        curr_pcb->open_files[ends[i]].inode_num = (uint32_t)p;
+        curr_pcb->open_files[ends[i]].file_pos = 0;
+        curr_pcb->open_files[ends[i]].flags = FLAG_BUSY;
+    }
+
+    fds[0] = ends[0];
+    fds[1] = ends[1];
+
+    return 0;
+}
+
+int32_t pipe_fd(PCB_entry_t* file) {
+    return file->file_op_table.close == pipe_close;
+}
+
+void pipe_ref(PCB_entry_t* file) {
+    pipe_t* p = (pipe_t *)file->inode_num;
+
+    if (!pipe_fd(file)) return;
+
+    if (file->file_op_table.read == pipe_read) p->readers++;
+    else p->writers++;
+}
+
+/*
+ * DESCRIPTION: Reads from a pipe, blocking until there is data. Returns
+ * whatever is buffered (or the rest of the first spliced page), up to
+ * nbytes, without waiting for more.
+ *
+ * INPUTS: fd -- read end, buf -- buffer, nbytes -- most bytes to read
+ *
+ * OUTPUTS: bytes read, 0 once the pipe is empty and every write end is
+ * closed
+ *
+ * SIDE EFFECTS: may sleep, wakes writers waiting for room
+ */
+int32_t pipe_read(int32_t fd, void* buf, int32_t nbytes) {
+    pipe_t* p = PIPE_OF(fd);
+    uint32_t n, first, flags;
+
+    cli_and_save(flags);
+
+    while (p->count == 0 && p->npages == 0 && p->writers > 0) sleep_on(&p->read_wait);
+
+    if (p->npages > 0) {
+        n = FOUR_KB_SIZE - p->page_off;
+        if (n > (uint32_t)nbytes) n = nbytes;
+        memcpy(buf, (uint8_t *)p->pages[p->page_head] + p->page_off, n);
+
+        p->page_off += n;
+        if (p->page_off == FOUR_KB_SIZE) {
+            frame_free(p->pages[p->page_head]);
+            pipe_pop_page(p);
+        }
+
+        if (n > 0) wake_up(&p->write_wait);
+
+        restore_flags(flags);
+
+        return n;
+    }
+
+    n = ((uint32_t)nbytes < p->count) ? (uint32_t)nbytes : p->count;
+
+    // the data may wrap around the end of the buffer
+    first = PIPE_SIZE - p->head;
+    if (first > n) first = n;
+    memcpy(buf, p->buf + p->head, first);
+    memcpy((uint8_t *)buf + first, p->buf, n - first);
+
+    p->head = (p->head + n) % PIPE_SIZE;
+    p->count -= n;
+
+    if (n > 0) wake_up(&p->write_wait);
+
+    restore_flags(flags);
+
+    return n;
+}
+
+/*
+ * DESCRIPTION: Writes to a pipe, blocking while it is full (or spliced
+ * pages are waiting) until all of buf is in.
+ *
+ * INPUTS: fd -- write end, buf -- data, nbytes -- its length
+ *
+ * OUTPUTS: nbytes, fewer if every read end is closed part way, -1 if
+ * they were all closed before anything was written
+ *
+ * SIDE EFFECTS: may sleep, wakes readers waiting for data
+ */
+int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes) {
+    pipe_t* p = PIPE_OF(fd);
+    uint32_t written = 0, n, tail, first, flags;
+
+    cli_and_save(flags);
+
+    while (written < (uint32_t)nbytes && p->readers > 0) {
+        if (p->count == PIPE_SIZE || p->npages > 0) {
+            sleep_on(&p->write_wait);
+            continue;
+        }
+
+        n = PIPE_SIZE - p->count;
+        if (n > nbytes - written) n = nbytes - written;
+
+        tail = (p->head + p->count) % PIPE_SIZE;
+        first = PIPE_SIZE - tail;
+        if (first > n) first = n;
+        memcpy(p->buf + tail, (uint8_t *)buf + written, first);
+        memcpy(p->buf, (uint8_t *)buf + written + first, n - first);
+
+        p->count += n;
+        written += n;
+
+        wake_up(&p->read_wait);
+    }
+
+    restore_flags(flags);
+
+    return (written == 0 && nbytes > 0) ? -1 : (int32_t)written;
+}
+
+/*
+ * DESCRIPTION: Splices whole pages of buf into a pipe: their frames are
+ * taken out of the process and queued, no copy. The process is left
+ * with zeroed pages in their place. Whatever doesn't fill a page, or an
+ * unaligned buf, is written through the buffer like pipe_write.
+ *
+ * INPUTS: fd -- write end, buf -- data, nbytes -- its length
+ *
+ * OUTPUTS: bytes written, fewer if every read end is closed or a page
+ * is invalid part way, -1 if nothing was written
+ *
+ * SIDE EFFECTS: remaps the process' pages, may sleep, wakes readers
+ */
+int32_t pipe_splice_write(int32_t fd, const void* buf, int32_t nbytes) {
+    pipe_t* p = PIPE_OF(fd);
+    uint32_t va = (uint32_t)buf, moved = 0, frame, flags;
+    int32_t ret;
+
+    if (va & (FOUR_KB_SIZE - 1)) return pipe_write(fd, buf, nbytes);
+
+    cli_and_save(flags);
+
+    while (moved + FOUR_KB_SIZE <= (uint32_t)nbytes && p->readers > 0) {
+        // bytes already buffered have to be read first
+        if (p->count > 0 || p->npages == PIPE_PAGES) {
+            sleep_on(&p->write_wait);
+            continue;
+        }
+
+        frame = user_page_take(curr_pcb->page_table, va + moved);
+        if (!frame) break;
+
+        p->pages[(p->page_head + p->npages) % PIPE_PAGES] = frame;
+        p->npages++;
+        moved += FOUR_KB_SIZE;
+
+        wake_up(&p->read_wait);
+    }
+
+    restore_flags(flags);
+
+    // stopped early
+    if (moved < (uint32_t)(nbytes - nbytes % FOUR_KB_SIZE)) return moved ? (int32_t)moved : -1;
+
+    if (moved == (uint32_t)nbytes) return moved;
+
+    ret = pipe_write(fd, (uint8_t *)buf + moved, nbytes - moved);
+    if (ret == -1) return moved ? (int32_t)moved : -1;
+
+    return moved + ret;
+}
+
+/*
+ * DESCRIPTION: Reads from a pipe, blocking until there is data. Spliced
+ * pages are mapped straight into an aligned buf, as many as fit, no
+ * copy; anything else is read like pipe_read.
+ *
+ * INPUTS: fd -- read end, buf -- buffer, nbytes -- most bytes to read
+ *
+ * OUTPUTS: bytes read, 0 once the pipe is empty and every write end is
+ * closed
+ *
+ * SIDE EFFECTS: remaps the process' pages, may sleep, wakes writers
+ */
+int32_t pipe_splice_read(int32_t fd, void* buf, int32_t nbytes) {
+    pipe_t* p = PIPE_OF(fd);
+    uint32_t va = (uint32_t)buf, moved = 0, flags;
+
+    cli_and_save(flags);
+
+    while (p->count == 0 && p->npages == 0 && p->writers > 0) sleep_on(&p->read_wait);
+
+    if (!(va & (FOUR_KB_SIZE - 1)) && p->page_off == 0) {
+        while (p->npages > 0 && moved + FOUR_KB_SIZE <= (uint32_t)nbytes) {
+            if (user_page_give(curr_pcb->page_table, va + moved, p->pages[p->page_head])) break;
+
+            pipe_pop_page(p);
+            moved += FOUR_KB_SIZE;
+        }
+
+        if (moved > 0) wake_up(&p->write_wait);
+    }
+
+    restore_flags(flags);
+
+    return moved ? (int32_t)moved : pipe_read(fd, buf, nbytes);
+}
+
+/*
+ * DESCRIPTION: Closes one fd of a pipe. Closing the last write end lets
+ * readers see the end of the data; closing the last read end makes
+ * writes fail. The pipe goes once both ends are closed.
+ *
+ * INPUTS: fd -- either end
+ *
+ * OUTPUTS: 0
+ *
+ * SIDE EFFECTS: wakes the other end's sleepers, may free the pipe
+ */
+int32_t pipe_close(int32_t fd) {
+    pipe_t* p = PIPE_OF(fd);
+    uint32_t flags;
+
+    cli_and_save(flags);
+
+    if (curr_pcb->open_files[fd].file_op_table.read == pipe_read) {
+        if (--p->readers == 0) wake_up(&p->write_wait);
+    }
+    else if (--p->writers == 0) wake_up(&p->read_wait);
+
+    if (p->readers == 0 && p->writers == 0) {
+        while (p->npages > 0) {
+            frame_free(p->pages[p->page_head]);
+            pipe_pop_page(p);
+        }
+        frame_free((uint32_t)p->buf);
+        kfree(p);
+    }
+
+    restore_flags(flags);
+
+    return 0;
+}
@@ -0,0 +1,35 @@
+/*
+ * pipe.h - Pipes: a ring buffer with a read end and a write end fd.
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _PIPE_H
+#define _PIPE_H
+
+#include "types.h"
+#include "lib.h"
+
+#define PIPE_SIZE           FOUR_KB_SIZE    // bytes buffered between the ends
+#define PIPE_PAGES          16              // spliced pages in flight
+
+/* Opens a pipe into two free fds of the current process, read end in
+ * fds[0], write end in fds[1]. Returns 0, -1 if fds or memory run out. */
+int32_t pipe_create(int32_t* fds);
+
+/* Whether an fd entry is one end of a pipe. */
+int32_t pipe_fd(PCB_entry_t* file);
+
+/* Another fd entry now refers to the same end (dup2, fork, inheritance). */
+void pipe_ref(PCB_entry_t* file);
+
+/* Move whole pages of an aligned buffer through the pipe by remapping
+ * them instead of copying; anything else is copied like read/write. */
+int32_t pipe_splice_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t pipe_splice_write(int32_t fd, const void* buf, int32_t nbytes);
+
+/* fop_t operations of the two ends */
+int32_t pipe_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes);
+int32_t pipe_close(int32_t fd);
+
+#endif /* _PIPE_H */
@@ -13,6 +13,13 @@ volatile int rtc_intr_flag[3] = {0, 0, 0};
 int rtc_counter[3] = {0, 0, 0};
 int rtc_period[3] = {0, 0, 0};
 
+// processes sleeping in rtc_read, per terminal
+wait_queue_t rtc_wait[3];
+
+// number of open rtc files -- the IRQ is masked while nobody uses it,
+// so an idle system isn't woken up 1024 times a second
+int rtc_users = 0;
+
 /*
  * DESCRIPTION: Initializes frequency of rtc and enables periodic interrupts.
  *
@@ -33,8 +40,8 @@ void rtc_init(void)
    outb((DISABLE_NMI | REG_B), RTC_IDXPORT); // now have to write to this port
    outb((prev | ENABLE_PERIODIC_INTERRUPT), RTC_RWPORT); 
 
-   // enables interrupts
-   enable_irq(RTC_IRQ);
+   // interrupts are enabled by rtc_open
+   rtc_users = 0;
 
    // // initialize frequency by writing to Register A
    // outb((DISABLE_NMI | REG_A), RTC_IDXPORT);
@@ -78,6 +85,7 @@ void rtc_handler(void)
       if (rtc_counter[i] == 0) {
          rtc_intr_flag[i] = 1;
          rtc_counter[i] = rtc_period[i];
+         wake_up(&rtc_wait[i]);
       }
    }
 
@@ -94,7 +102,7 @@ void rtc_handler(void)
  * 
  * OUTPUTS: returns 0 upon success
  * 
- * SIDE EFFECTS: sets a default rtc frequency of 2 Hz
+ * SIDE EFFECTS: sets a default rtc frequency of 2 Hz, unmasks the RTC IRQ
  */
 int32_t rtc_open(const uint8_t* file) {
    // initializing 2 Hz frequency
@@ -104,6 +112,9 @@ int32_t rtc_open(const uint8_t* file) {
    // rtc is running on executing terminal
    rtc_on[exec_terminal] = 1;
 
+   // enables interrupts for first user
+   if (rtc_users++ == 0) enable_irq(RTC_IRQ);
+
    // how often the virtual RTC will send interrupt
    // rtc_period[exec_terminal] = TARGET_FREQ / freq;
 
@@ -120,11 +131,15 @@ int32_t rtc_open(const uint8_t* file) {
  * 
  * OUTPUTS: returns 0 upon success
  * 
- * SIDE EFFECTS: none
+ * SIDE EFFECTS: masks the RTC IRQ once no rtc files are open
  */
 int32_t rtc_close(int32_t fd) {
 
    rtc_on[exec_terminal] = 0;
+
+   // last user gone -- stop interrupts
+   if (rtc_users > 0 && --rtc_users == 0) disable_irq(RTC_IRQ);
+
    return 0;
 } 
 
@@ -137,7 +152,7 @@ int32_t rtc_close(int32_t fd) {
  * 
  * OUTPUTS: returns 0 upon completion
  * 
- * SIDE EFFECTS: sets a default rtc frequency of 2 Hz
+ * SIDE EFFECTS: blocks the calling process until the next virtual interrupt
  */
 int32_t rtc_read(int32_t fd, void* buf, int32_t bytes) {
    // intr_flag = 0;
@@ -151,13 +166,13 @@ int32_t rtc_read(int32_t fd, void* buf, int32_t bytes) {
       rtc_intr_flag[exec_terminal] = 0;
    }
 
-   sti();
-
-   // wait for interrupt flag
-   while(rtc_intr_flag[exec_terminal] == 0) {}
-   
    cli();
 
+   // sleep until interrupt flag is set -- rtc_handler wakes us
+   while(rtc_intr_flag[exec_terminal] == 0) {
+      sleep_on(&rtc_wait[exec_terminal]);
+   }
+
    return 0;
 }
 
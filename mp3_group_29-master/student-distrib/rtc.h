@@ -48,6 +48,9 @@
 // - variables to help keep track of active process, current frequency, etc.
 // MAKE SURE TO MODIFY rtc_init() if these variables need to be initialized
 
+// number of open rtc files (fork duplicates them)
+extern int rtc_users;
+
 /* Publicly available functions. */
 
 /* Initializes RTC. */
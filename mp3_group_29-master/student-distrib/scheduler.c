@@ -0,0 +1,469 @@
+#include "scheduler.h"
+#include "syscalls.h"
+#include "i8253.h"
+
+// run queues -- one FIFO of PCBs per MLFQ level, linked through pcb->next
+static PCB_t* run_head[NUM_LEVELS];
+static PCB_t* run_tail[NUM_LEVELS];
+
+// quantum of each level in PIT ticks (~10 ms each)
+static const uint32_t level_quantum[NUM_LEVELS] = {1, 2, 4};
+
+// ticks since last global priority boost
+static uint32_t boost_count = 0;
+
+// saved stack of the idle task (the boot context, see sched_idle)
+static uint32_t idle_esp, idle_ebp;
+
+/*
+ * DESCRIPTION: Finds the highest priority level with a runnable process.
+ *
+ * INPUTS: none
+ *
+ * OUTPUTS: level number, NUM_LEVELS if all queues are empty
+ *
+ * SIDE EFFECTS: none
+ */
+static uint32_t highest_ready_level(void) {
+    uint32_t level;
+
+    for (level = 0; level < NUM_LEVELS; level++) {
+        if (run_head[level]) break;
+    }
+
+    return level;
+}
+
+/*
+ * DESCRIPTION: Pops the process at the front of the highest priority
+ * non-empty run queue.
+ *
+ * INPUTS: none
+ *
+ * OUTPUTS: next runnable PCB, NULL if all queues are empty
+ *
+ * SIDE EFFECTS: modifies run queue
+ */
+static PCB_t* sched_dequeue(void) {
+    uint32_t level = highest_ready_level();
+    PCB_t* pcb;
+
+    if (level == NUM_LEVELS) return NULL;
+
+    pcb = run_head[level];
+
+    run_head[level] = pcb->next;
+    if (!run_head[level]) run_tail[level] = NULL;
+
+    pcb->next = NULL;
+
+    return pcb;
+}
+
+/*
+ * DESCRIPTION: Marks process as runnable and adds it to the back of
+ * the run queue for its level.
+ *
+ * INPUTS: pcb -- process to be queued
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: modifies run queue
+ */
+void sched_enqueue(PCB_t* pcb) {
+    uint32_t level;
+
+    if (!pcb) return;
+
+    level = pcb->priority;
+
+    pcb->state = PROC_READY;
+    pcb->next = NULL;
+
+    if (run_tail[level]) run_tail[level]->next = pcb;
+    else run_head[level] = pcb;
+
+    run_tail[level] = pcb;
+}
+
+/*
+ * DESCRIPTION: Takes a process out of the run queue if it is there.
+ *
+ * INPUTS: pcb -- process to be removed
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: modifies run queue
+ */
+void sched_remove(PCB_t* pcb) {
+    uint32_t level = pcb->priority;
+    PCB_t* prev = NULL;
+    PCB_t* cur = run_head[level];
+
+    while (cur && cur != pcb) {
+        prev = cur;
+        cur = cur->next;
+    }
+
+    if (!cur) return; // not queued
+
+    if (prev) prev->next = cur->next;
+    else run_head[level] = cur->next;
+
+    if (run_tail[level] == cur) run_tail[level] = prev;
+
+    cur->next = NULL;
+}
+
+/*
+ * DESCRIPTION: Moves a process to the given level with a full quantum.
+ * Must not be called on a queued process (remove it first).
+ *
+ * INPUTS: pcb -- process, level -- new MLFQ level
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: modifies pcb priority and quantum
+ */
+void sched_set_level(PCB_t* pcb, uint32_t level) {
+    if (level >= NUM_LEVELS) level = NUM_LEVELS - 1;
+
+    pcb->priority = level;
+    pcb->ticks_left = level_quantum[level];
+}
+
+/*
+ * DESCRIPTION: Moves every runnable process back to its base level so
+ * CPU bound processes at the bottom can't starve forever.
+ *
+ * INPUTS: none
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: rebuilds run queues
+ */
+static void sched_boost_all(void) {
+    PCB_t* queued[NUM_LEVELS];
+    PCB_t* pcb;
+    PCB_t* next;
+    uint32_t level;
+
+    // detach every queue first so nothing is visited twice
+    for (level = 0; level < NUM_LEVELS; level++) {
+        queued[level] = run_head[level];
+        run_head[level] = NULL;
+        run_tail[level] = NULL;
+    }
+
+    for (level = 0; level < NUM_LEVELS; level++) {
+        for (pcb = queued[level]; pcb; pcb = next) {
+            next = pcb->next;
+            sched_set_level(pcb, pcb->base_priority);
+            sched_enqueue(pcb);
+        }
+    }
+
+    if (curr_pcb) sched_set_level(curr_pcb, curr_pcb->base_priority);
+}
+
+/*
+ * DESCRIPTION: Builds a kernel stack for a process that has never run so
+ * that the first switch_stack into it "returns" into context_switch,
+ * which irets to the program's entry point.
+ *
+ * INPUTS: pcb -- loaded process, eip -- user entry point
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: writes top of the process' kernel stack, queues process
+ */
+void sched_new_process(PCB_t* pcb, uint32_t eip) {
+    uint32_t* stack = (uint32_t *)pcb->kernel_stack;
+
+    *(--stack) = eip;                       // context_switch's argument
+    *(--stack) = 0;                         // fake return address for context_switch
+
+    sched_new_context(pcb, stack, (uint32_t)context_switch);
+}
+
+/*
+ * DESCRIPTION: Queues a process that has never run. The first switch_stack
+ * into it "returns" to ret with esp at stack, whatever the caller has
+ * put there.
+ *
+ * INPUTS: pcb -- new process, stack -- top of its prepared kernel stack,
+ * ret -- where it starts running
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: writes below stack, queues process
+ */
+void sched_new_context(PCB_t* pcb, uint32_t* stack, uint32_t ret) {
+    *(--stack) = ret;                       // switch_stack returns here
+    *(--stack) = 0;                         // ebp
+    pcb->user_ebp = (uint32_t)stack;
+    *(--stack) = 0;                         // ebx
+    *(--stack) = 0;                         // esi
+    *(--stack) = 0;                         // edi
+    pcb->user_esp = (uint32_t)stack;
+
+    sched_enqueue(pcb);
+}
+
+/*
+ * DESCRIPTION: Arms the PIT for the next moment the scheduler has to step
+ * in while pcb runs: the end of its quantum, the next global boost, or
+ * the next tick if a higher level is waiting. With nothing else runnable
+ * there is no deadline at all.
+ *
+ * INPUTS: pcb -- process about to run
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: reprograms PIT
+ */
+static void sched_arm_timer(PCB_t* pcb) {
+    uint32_t level = highest_ready_level();
+    uint32_t ticks;
+
+    if (!pcb || level == NUM_LEVELS) {
+        pit_clear_deadline();
+        return;
+    }
+
+    ticks = pcb->ticks_left;
+
+    if (level < pcb->priority) ticks = 1;
+
+    if (BOOST_PERIOD - boost_count < ticks) ticks = BOOST_PERIOD - boost_count;
+
+    pit_set_deadline(ticks);
+}
+
+/*
+ * DESCRIPTION: Starts a root shell for each terminal. The shells are only
+ * queued; they start running once the boot context becomes the idle task.
+ *
+ * INPUTS: none
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: loads shell into memory three times
+ */
+void sched_init(void) {
+    int32_t i;
+    PCB_t* pcb;
+
+    curr_pcb = NULL;
+
+    for (i = 0; i < NUM_TERMINALS; i++) {
+        exec_terminal = i;
+
+        // for user to keep track of current terminal
+        switch_terminal(i);
+        set_vidmem(exec_terminal);
+        printf("Terminal %d\n", i + 1);
+
+        if (create_process((uint8_t *)"shell", i, &pcb) != 0) continue;
+
+        terminals[i].pcb = pcb;
+        sched_new_process(pcb, pcb->entry);
+    }
+
+    switch_terminal(0);
+    set_vidmem(exec_terminal);
+}
+
+/*
+ * DESCRIPTION: Accounts elapsed PIT ticks to the running process. A process
+ * that uses its whole quantum is CPU bound and drops a level; a process is
+ * also preempted if something at a higher level became runnable.
+ *
+ * INPUTS: ticks -- ticks since the deadline was armed
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: may switch processes, re-arms PIT
+ */
+void sched_tick(uint32_t ticks) {
+    PCB_t* pcb = curr_pcb;
+
+    boost_count += ticks;
+
+    if (boost_count >= BOOST_PERIOD) {
+        boost_count = 0;
+        sched_boost_all();
+    }
+
+    // idle task -- let it pick up whatever is runnable
+    if (!pcb) {
+        schedule();
+        return;
+    }
+
+    pcb->ticks_left = (pcb->ticks_left > ticks) ? pcb->ticks_left - ticks : 0;
+
+    if (pcb->ticks_left == 0) {
+        sched_set_level(pcb, pcb->priority + 1);
+        schedule();
+        return;
+    }
+
+    if (highest_ready_level() < pcb->priority) {
+        schedule();
+        return;
+    }
+
+    // deadline was clipped or for a boost -- keep going
+    sched_arm_timer(pcb);
+}
+
+/*
+ * DESCRIPTION: Puts the running process at the back of its run queue and
+ * switches to the process at the front of the highest level. Processes
+ * that aren't runnable (e.g. parents waiting in execute) are never in the
+ * queue so they cost nothing; when nothing is runnable the idle task runs.
+ * Interrupts must be off.
+ *
+ * INPUTS: none
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: changes curr_pcb, exec_terminal, paging and tss, arms PIT
+ */
+void schedule(void) {
+    PCB_t* prev = curr_pcb;
+    PCB_t* next;
+
+    if (prev && prev->state == PROC_RUNNING) sched_enqueue(prev);
+
+    next = sched_dequeue();
+
+    // nothing to run -- no deadline needed until something wakes up
+    if (!next) {
+        pit_clear_deadline();
+
+        // already idle
+        if (!prev) return;
+
+        // everything is blocked -- switch to the idle task
+        curr_pcb = NULL;
+        switch_stack(&prev->user_esp, &prev->user_ebp, idle_esp, idle_ebp);
+        return;
+    }
+
+    next->state = PROC_RUNNING;
+
+    sched_arm_timer(next);
+
+    if (next == prev) return;
+
+    // switch terminal execution
+    exec_terminal = next->terminal;
+
+    // remaps and sets video memory in paging
+    switch_vid();
+    set_vidmem(exec_terminal);
+
+    // switches paging
+    switch_pd(next->page_table);
+
+    // updates tss
+    tss.ss0 = KERNEL_DS;
+    tss.esp0 = next->kernel_stack;
+
+    curr_pcb = next;
+
+    // save esp and ebp, restore next process'
+    if (prev) switch_stack(&prev->user_esp, &prev->user_ebp, next->user_esp, next->user_ebp);
+    else switch_stack(&idle_esp, &idle_ebp, next->user_esp, next->user_ebp);
+}
+
+/*
+ * DESCRIPTION: Idle task. The boot context ends up here once the kernel is
+ * initialized and is switched to whenever every process is blocked. It
+ * halts the CPU until an interrupt makes something runnable; since the PIT
+ * is disarmed while idle, only real device interrupts wake it.
+ *
+ * INPUTS: none
+ *
+ * OUTPUTS: none (never returns)
+ *
+ * SIDE EFFECTS: runs processes
+ */
+void sched_idle(void) {
+    while (1) {
+        cli();
+
+        if (highest_ready_level() < NUM_LEVELS) schedule();
+
+        // sti takes effect after hlt starts, so no wakeup is missed
+        asm volatile("sti; hlt");
+    }
+}
+
+/*
+ * DESCRIPTION: Puts the running process to sleep on a wait queue and runs
+ * something else. Callers should re-check their condition in a loop,
+ * since every sleeper is woken at once. Interrupts must be off.
+ *
+ * INPUTS: wq -- queue to sleep on
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: blocks until wake_up(wq)
+ */
+void sleep_on(wait_queue_t* wq) {
+    PCB_t* pcb = curr_pcb;
+
+    // no process (e.g. kernel tests) -- just wait for an interrupt
+    if (!pcb) {
+        sti();
+        asm volatile("hlt");
+        cli();
+        return;
+    }
+
+    pcb->state = PROC_SLEEPING;
+    pcb->next = NULL;
+
+    if (wq->tail) wq->tail->next = pcb;
+    else wq->head = pcb;
+
+    wq->tail = pcb;
+
+    schedule();
+}
+
+/*
+ * DESCRIPTION: Moves every process sleeping on the queue back to the run
+ * queue. Having waited on I/O, they go back to their base MLFQ level so
+ * interactive processes respond quickly. Safe to call from interrupt
+ * handlers.
+ *
+ * INPUTS: wq -- queue to wake
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: modifies run queue
+ */
+void wake_up(wait_queue_t* wq) {
+    PCB_t* pcb = wq->head;
+    PCB_t* next;
+
+    wq->head = NULL;
+    wq->tail = NULL;
+
+    for (; pcb; pcb = next) {
+        next = pcb->next;
+        sched_set_level(pcb, pcb->base_priority);
+        sched_enqueue(pcb);
+    }
+
+    // the running process may have had no deadline (it was alone), or a
+    // higher level woke up and should preempt it on the next tick
+    if (curr_pcb && curr_pcb->state == PROC_RUNNING &&
+        (!pit_deadline_armed() ||
+         (highest_ready_level() < curr_pcb->priority && pit_deadline_armed() > 1)))
+        sched_arm_timer(curr_pcb);
+}
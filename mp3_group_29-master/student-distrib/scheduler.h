@@ -0,0 +1,56 @@
+/*
+ * scheduler.h - Run queue and context switching between processes.
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include "types.h"
+#include "lib.h"
+#include "x86_desc.h"
+#include "paging.h"
+
+#define NUM_TERMINALS 3
+
+/* Multi-level feedback queue. Level 0 is the highest priority and has the
+ * shortest quantum; processes that use up their quantum drop a level,
+ * processes that block on input are moved back up. */
+#define NUM_LEVELS      3
+#define BOOST_PERIOD    100     // PIT ticks (~1 s) between global boosts
+
+/* Starts a root shell on every terminal. */
+void sched_init(void);
+
+/* Adds/removes a process from the run queue. */
+void sched_enqueue(PCB_t* pcb);
+void sched_remove(PCB_t* pcb);
+
+/* Queues a freshly loaded process that has never run. */
+void sched_new_process(PCB_t* pcb, uint32_t eip);
+
+/* Queues a new process that starts by returning to ret on the given stack. */
+void sched_new_context(PCB_t* pcb, uint32_t* stack, uint32_t ret);
+
+/* Picks the next runnable process and switches to it. */
+void schedule(void);
+
+/* PIT deadline accounting -- demotes/preempts the running process. */
+void sched_tick(uint32_t ticks);
+
+/* Idle task -- runs when every process is blocked. Never returns. */
+void sched_idle(void);
+
+/* Sets a process' MLFQ level and gives it a fresh quantum. */
+void sched_set_level(PCB_t* pcb, uint32_t level);
+
+/* Blocks the running process until wake_up is called on the queue. */
+void sleep_on(wait_queue_t* wq);
+
+/* Makes every process sleeping on the queue runnable. */
+void wake_up(wait_queue_t* wq);
+
+/* Assembly linkage -- saves current kernel stack, loads the next one. */
+void switch_stack(uint32_t* save_esp, uint32_t* save_ebp, uint32_t next_esp, uint32_t next_ebp);
+
+#endif /* _SCHEDULER_H */
@@ -0,0 +1,103 @@
+#include "shm.h"
+#include "frame.h"
+#include "paging.h"
+
+/* A segment's frames. The table holds one reference to each, every page
+ * table it is attached to another; the segment is unused once only the
+ * table's are left. Segments live on after their last process halts, so
+ * a consumer can attach to what a producer left. */
+typedef struct shm_segment {
+    uint32_t key;
+    uint32_t pages;
+    uint32_t frames[SHM_MAX_PAGES];
+    uint32_t valid;
+} shm_segment_t;
+
+static shm_segment_t segments[SHM_SEGMENTS];
+
+/*
+ * DESCRIPTION: Frees a segment no process has attached.
+ *
+ * INPUTS: seg -- segment
+ *
+ * OUTPUTS: 0 if it was freed, -1 if it is attached somewhere
+ *
+ * SIDE EFFECTS: frees the segment's frames
+ */
+static int32_t shm_reclaim(shm_segment_t* seg) {
+    uint32_t i;
+
+    if (frame_refcount(seg->frames[0]) > 1) return -1;
+
+    for (i = 0; i < seg->pages; i++) frame_free(seg->frames[i]);
+    seg->valid = 0;
+
+    return 0;
+}
+
+/*
+ * DESCRIPTION: Looks up or creates a segment. When every slot is taken a
+ * segment nobody has attached is reclaimed for the new one.
+ *
+ * INPUTS: key -- name the cooperating processes agreed on, size -- bytes
+ * the caller needs
+ *
+ * OUTPUTS: segment id, -1 on failure
+ *
+ * SIDE EFFECTS: may allocate and zero frames, may free an unused segment
+ */
+int32_t shm_get(uint32_t key, uint32_t size) {
+    shm_segment_t* seg = NULL;
+    uint32_t i, pages, flags;
+
+    if (size == 0 || size > SHM_MAX_PAGES * FOUR_KB_SIZE) return -1;
+    pages = (size + FOUR_KB_SIZE - 1) / FOUR_KB_SIZE;
+
+    cli_and_save(flags);
+
+    for (i = 0; i < SHM_SEGMENTS; i++) {
+        if (segments[i].valid && segments[i].key == key) {
+            restore_flags(flags);
+            return (segments[i].pages >= pages) ? (int32_t)i : -1;
+        }
+        if (!segments[i].valid && !seg) seg = &segments[i];
+    }
+
+    for (i = 0; i < SHM_SEGMENTS && !seg; i++) {
+        if (shm_reclaim(&segments[i]) == 0) seg = &segments[i];
+    }
+
+    if (!seg) {
+        restore_flags(flags);
+        return -1;
+    }
+
+    for (i = 0; i < pages; i++) {
+        if (!(seg->frames[i] = frame_alloc())) {
+            while (i-- > 0) frame_free(seg->frames[i]);
+            restore_flags(flags);
+            return -1;
+        }
+        memset((void *)seg->frames[i], 0, FOUR_KB_SIZE);
+    }
+
+    seg->key = key;
+    seg->pages = pages;
+    seg->valid = 1;
+
+    restore_flags(flags);
+
+    return seg - segments;
+}
+
+uint32_t shm_size(int32_t id) {
+    if (id < 0 || id >= SHM_SEGMENTS || !segments[id].valid) return 0;
+
+    return segments[id].pages * FOUR_KB_SIZE;
+}
+
+int32_t shm_attach(int32_t id, uint32_t pt, uint32_t va) {
+    if (!shm_size(id)) return -1;
+
+    return user_map_frames(pt, va, segments[id].frames, segments[id].pages);
+}
@@ -0,0 +1,27 @@
+/*
+ * shm.h - Shared memory segments, mapped into several processes at once.
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _SHM_H
+#define _SHM_H
+
+#include "types.h"
+#include "lib.h"
+
+#define SHM_SEGMENTS        16      // segments that can exist at once
+#define SHM_MAX_PAGES       16      // largest segment, in 4KB pages (64KB)
+
+/* Finds the segment with a key, creating it (zeroed) if there is none.
+ * Returns the segment id, -1 if size is 0, too big for the segment or
+ * the segment table / memory is full. */
+int32_t shm_get(uint32_t key, uint32_t size);
+
+/* Size of a segment in bytes (whole pages), 0 for a bad id. */
+uint32_t shm_size(int32_t id);
+
+/* Maps a segment writable into a user page table at page aligned va.
+ * Returns 0, or -1 if a page there is already mapped. */
+int32_t shm_attach(int32_t id, uint32_t pt, uint32_t va);
+
+#endif /* _SHM_H */
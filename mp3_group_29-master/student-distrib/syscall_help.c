@@ -8,20 +8,23 @@ fop_t dir_fop = {dir_open, dir_close, dir_read, dir_write};
 fop_t filesys_fop = {file_open, file_close, file_read, file_write};
 fop_t rtc_fop = {rtc_open, rtc_close, rtc_read, rtc_write};
 
+// pid -> PCB, NULL while the pid is free. Sized from the amount of RAM in
+// pid_init, so the process limit is whatever memory allows.
+static PCB_t** pid_table = NULL;
+static int32_t* pid_next_free;  // free pids form a linked stack through this
+static int32_t pid_free_head = -1;
+static uint32_t pid_max = 0;
+
 // Initializes global variables to default values
 void init_vars(void) {
-    int i;
-
     cur_pid = 0;
     //parent_pid = 0;
     // process at pid
 
-    // determines which pid is free -- up to 6 processes
-    for (i = 0; i < 6; i++) process_flag[i] = 0;
     // global_status = 255;
-    num_programs = 0;
-    exec_terminal = 1;
+    exec_terminal = 0;
     disp_terminal = 0;
+    curr_pcb = NULL;
 
 }
 
@@ -40,7 +43,7 @@ int32_t valid_fd(int32_t fd) {
     if (fd >= 0 && fd < 8) { // up to 8 processes
 
         // TODO: ADD CHECK HERE TO ENSURE PRESENT PROCESS
-        if (terminals[exec_terminal].pcb->open_files[fd].flags != FLAG_BUSY) return -1;
+        if (curr_pcb->open_files[fd].flags != FLAG_BUSY) return -1;
 
         return 0;
     }
@@ -60,15 +63,52 @@ int32_t valid_fd(int32_t fd) {
 void clear_fd(int32_t fd) {
 
     // clears file operation table
-    terminals[exec_terminal].pcb->open_files[fd].file_op_table.open = 0;
-    terminals[exec_terminal].pcb->open_files[fd].file_op_table.close = 0;
-    terminals[exec_terminal].pcb->open_files[fd].file_op_table.read = 0;
-    terminals[exec_terminal].pcb->open_files[fd].file_op_table.write = 0;
+    curr_pcb->open_files[fd].file_op_table.open = 0;
+    curr_pcb->open_files[fd].file_op_table.close = 0;
+    curr_pcb->open_files[fd].file_op_table.read = 0;
+    curr_pcb->open_files[fd].file_op_table.write = 0;
+
+    curr_pcb->open_files[fd].inode_num = 0;
+    curr_pcb->open_files[fd].file_pos = 0;
+    curr_pcb->open_files[fd].flags = FLAG_FREE;
+
+}
+
+/*
+ * DESCRIPTION: Accounts for one more fd entry referring to an open file,
+ * for files whose state is shared between entries (rtc, pipes).
+ *
+ * INPUTS: file -- the new entry, already a copy of the old one
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: bumps the rtc user count or pipe end count
+ */
+void fd_ref(PCB_entry_t* file) {
+    if (file->flags != FLAG_BUSY) return;
 
-    terminals[exec_terminal].pcb->open_files[fd].inode_num = 0;
-    terminals[exec_terminal].pcb->open_files[fd].file_pos = 0;
-    terminals[exec_terminal].pcb->open_files[fd].flags = FLAG_FREE;
+    if (file->file_op_table.open == rtc_open) rtc_users++;
+    else pipe_ref(file);
+}
 
+/*
+ * DESCRIPTION: Closes any fd of the current process, stdin and stdout
+ * included. Terminal entries are only dropped -- the terminal itself
+ * stays open for the other fds and processes using it.
+ *
+ * INPUTS: fd -- file descriptor in current PCB
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: closes the file, frees the entry
+ */
+void fd_release(int32_t fd) {
+    if (valid_fd(fd) == -1) return;
+
+    if (curr_pcb->open_files[fd].file_op_table.open != terminal_open)
+        curr_pcb->open_files[fd].file_op_table.close(fd);
+
+    clear_fd(fd);
 }
 
 /*
@@ -111,12 +151,27 @@ void pcb_init(PCB_t* pcb_ptr , uint8_t* cmd, uint8_t (*argv)[MAX_ARGS], uint32_t
     pcb_ptr->pid = pid;
     pcb_ptr->parent_pid = 0;
 
-    pcb_ptr->scheduled = 0; // default zero
     pcb_ptr->is_shell = 0;
+    pcb_ptr->async = 0;
+    pcb_ptr->exit_status = 0;
+    pcb_ptr->mmap_base = USER_MMAP_TOP;
+    pcb_ptr->child_wait.head = NULL;
+    pcb_ptr->child_wait.tail = NULL;
+    pcb_ptr->children = NULL;
+    pcb_ptr->next_sibling = NULL;
+    pcb_ptr->prev_sibling = NULL;
+
+    pcb_ptr->state = PROC_FREE; // not runnable until execute/scheduler says so
+    pcb_ptr->terminal = exec_terminal;
+    pcb_ptr->next = NULL;
+
+    // children keep their parent's niceness, and start at the top
+    pcb_ptr->base_priority = (curr_pcb) ? curr_pcb->base_priority : 0;
+    sched_set_level(pcb_ptr, pcb_ptr->base_priority);
 
     pcb_ptr->parent_esp  = 0;
     pcb_ptr->parent_ebp  = 0;
-    pcb_ptr->parent_pcb  =  terminals[exec_terminal].pcb;
+    pcb_ptr->parent_pcb  =  curr_pcb;
     pcb_ptr->tss_esp0    =  tss.esp0;
 
     pcb_ptr->num_args = arg_num; // silly naming here... oh well
@@ -223,14 +278,192 @@ int32_t parse_cmd(const uint8_t* command, uint8_t* parsed_cmd, uint8_t (*argv)[M
     return j;
 }
 
-/* DESCRIPTION: Calculates PCB given a pid
+/*
+ * DESCRIPTION: Sets up the pid table. Every process needs at least a
+ * PCB/kernel stack, so there can never be more pids than that many frames.
+ *
+ * INPUTS: none
+ * 
+ * OUTPUTS: none
+ * 
+ * SIDE EFFECTS: allocates the table from the frame allocator, all pids free
+ */
+void pid_init(void) {
+    uint32_t i, frames;
+
+    pid_max = frames_total() / PCB_FRAMES;
+    frames = (pid_max * (sizeof(PCB_t*) + sizeof(int32_t)) + FOUR_KB_SIZE - 1) / FOUR_KB_SIZE;
+
+    pid_table = (PCB_t**)frame_alloc_contig(frames, 1);
+    if (!pid_table) pid_max = 0;
+
+    pid_next_free = (int32_t*)(pid_table + pid_max);
+    pid_free_head = (pid_max > 0) ? 0 : -1;
+
+    for (i = 0; i < pid_max; i++) {
+        pid_table[i] = NULL;
+        pid_next_free[i] = (i + 1 < pid_max) ? (int32_t)(i + 1) : -1;
+    }
+}
+
+/*
+ * DESCRIPTION: Hands out a free pid in O(1).
+ *
+ * INPUTS: pcb -- process the pid belongs to
+ * 
+ * OUTPUTS: the pid, -1 if none are free
+ * 
+ * SIDE EFFECTS: get_pcb(pid) returns pcb until pid_release
+ */
+int32_t pid_alloc(PCB_t* pcb) {
+    int32_t pid = pid_free_head;
+
+    if (pid < 0) return -1;
+
+    pid_free_head = pid_next_free[pid];
+    pid_table[pid] = pcb;
+
+    return pid;
+}
+
+/*
+ * DESCRIPTION: Returns a pid to the free list in O(1).
+ *
+ * INPUTS: pid -- pid from pid_alloc
+ * 
+ * OUTPUTS: none
+ * 
+ * SIDE EFFECTS: pid may be handed out again
+ */
+void pid_release(uint32_t pid) {
+    if (pid >= pid_max || !pid_table[pid]) return;
+
+    pid_table[pid] = NULL;
+    pid_next_free[pid] = pid_free_head;
+    pid_free_head = pid;
+}
+
+/* DESCRIPTION: Looks up the PCB of a pid
  *
  * INPUTS: pid -- the pid to obtain the PCB of
  *
- * OUTPUTS: PCB pointer
+ * OUTPUTS: PCB pointer, NULL if the pid is not in use
  */
 PCB_t* get_pcb(uint32_t pid){
-    return (PCB_t *)(EIGHT_MB_SIZE - (pid + 1) * EIGHT_KB_SIZE);
+    return (pid < pid_max) ? pid_table[pid] : NULL;
+}
+
+/*
+ * DESCRIPTION: Frees everything create_process allocated for a process:
+ * its pid, user pages and PCB/kernel stack.
+ *
+ * INPUTS: pcb -- process that has halted
+ * 
+ * OUTPUTS: none
+ * 
+ * SIDE EFFECTS: the PCB must not be used after the next allocation
+ */
+void release_process(PCB_t* pcb) {
+    PCB_t* parent = pcb->parent_pcb;
+
+    // off the parent's list of async children
+    if (parent && pcb->async) {
+        if (pcb->prev_sibling) pcb->prev_sibling->next_sibling = pcb->next_sibling;
+        else parent->children = pcb->next_sibling;
+        if (pcb->next_sibling) pcb->next_sibling->prev_sibling = pcb->prev_sibling;
+    }
+
+    pid_release(pcb->pid);
+    user_pt_destroy(pcb->page_table);
+    frame_free_contig((uint32_t)pcb, PCB_FRAMES);
+}
+
+/*
+ * DESCRIPTION: Adds an async child (fork/spawn) to its parent's list, so
+ * halt finds it without looking through the whole process table.
+ *
+ * INPUTS: parent -- running process, child -- its new async child
+ * 
+ * OUTPUTS: none
+ * 
+ * SIDE EFFECTS: none
+ */
+void child_link(PCB_t* parent, PCB_t* child) {
+    child->prev_sibling = NULL;
+    child->next_sibling = parent->children;
+    if (parent->children) parent->children->prev_sibling = child;
+    parent->children = child;
+}
+
+/*
+ * DESCRIPTION: Detaches a halting process from its async children. Ones
+ * that already halted are freed (nobody can wait for them any more), the
+ * others free themselves when they halt.
+ *
+ * INPUTS: pcb -- process that is halting
+ * 
+ * OUTPUTS: none
+ * 
+ * SIDE EFFECTS: frees zombie children
+ */
+void orphan_children(PCB_t* pcb) {
+    PCB_t* child;
+    PCB_t* next;
+
+    for (child = pcb->children; child; child = next) {
+        next = child->next_sibling;
+
+        // not on a list any more, release_process leaves the links alone
+        child->parent_pcb = NULL;
+        child->next_sibling = NULL;
+        child->prev_sibling = NULL;
+
+        if (child->state == PROC_ZOMBIE) release_process(child);
+    }
+
+    pcb->children = NULL;
+}
+
+/*
+ * DESCRIPTION: Finds where a program image ends in user memory. The file
+ * is loaded as-is at USER_PROGRAM_ADDR, but loadable segments may also
+ * reserve zeroed memory (.bss) past the end of the file.
+ *
+ * INPUTS: inode -- executable's inode, length -- file size in bytes
+ * 
+ * OUTPUTS: first virtual address past the image
+ * 
+ * SIDE EFFECTS: none
+ */
+uint32_t elf_image_end(uint32_t inode, uint32_t length) {
+    uint32_t end = USER_PROGRAM_ADDR + length;
+    uint32_t phoff = 0;
+    uint16_t phentsize = 0, phnum = 0;
+    uint32_t phdr[6]; // p_type, p_offset, p_vaddr, p_paddr, p_filesz, p_memsz
+    uint32_t i, seg_end;
+
+    if (length < ELF_PHNUM + 2) return end;
+
+    read_data(inode, ELF_PHOFF, (uint8_t *)&phoff, 4);
+    read_data(inode, ELF_PHENTSIZE, (uint8_t *)&phentsize, 2);
+    read_data(inode, ELF_PHNUM, (uint8_t *)&phnum, 2);
+
+    if (phentsize < sizeof(phdr)) return end;
+
+    for (i = 0; i < phnum; i++) {
+        if (phoff + i * phentsize + sizeof(phdr) > length) break;
+
+        read_data(inode, phoff + i * phentsize, (uint8_t *)phdr, sizeof(phdr));
+        if (phdr[0] != ELF_PT_LOAD) continue;
+
+        // ignore segments that don't fit below the user stack
+        seg_end = phdr[2] + phdr[5];
+        if (phdr[2] < USER_MEM || seg_end < phdr[2] || seg_end > USER_STACK_TOP) continue;
+
+        if (seg_end > end) end = seg_end;
+    }
+
+    return end;
 }
 
 //null fop placeholders
@@ -6,6 +6,9 @@
 #include "keyboard.h"
 #include "terminal.h"
 #include "filesys.h"
+#include "scheduler.h"
+#include "frame.h"
+#include "pipe.h"
 
 #define CARRIAGE_RETURN 0x0D
 
@@ -13,11 +16,22 @@ extern void init_vars(void); // initializes relevant global variables
 
 extern int32_t valid_fd(int32_t fd);
 extern void clear_fd(int32_t fd);
+void fd_ref(PCB_entry_t* file);
+void fd_release(int32_t fd);
 
 void pcb_init(PCB_t * pcb_ptr, uint8_t* cmd, uint8_t (*argv)[MAX_ARGS], uint32_t arg_num, uint32_t pid);
 
 int32_t parse_cmd(const uint8_t* command, uint8_t* parsed_cmd, uint8_t (*argv)[MAX_ARGS]);
+uint32_t elf_image_end(uint32_t inode, uint32_t length);
+
+// process table
+void pid_init(void);
+int32_t pid_alloc(PCB_t* pcb);
+void pid_release(uint32_t pid);
 PCB_t* get_pcb(uint32_t pid);
+void release_process(PCB_t* pcb);
+void child_link(PCB_t* parent, PCB_t* child);
+void orphan_children(PCB_t* pcb);
 
 int32_t null_read(int32_t fd, void *buf, int32_t nbytes);
 int32_t null_write(int32_t fd, const void *buf, int32_t nbytes);
@@ -1,5 +1,78 @@
 #include "syscalls.h"
 
+/*
+ * DESCRIPTION: Points a PCB at its program image. Nothing is loaded,
+ * the page fault handler pages the image in as it is touched.
+ *
+ * INPUTS: pcb_ptr -- process, inode -- executable's inode
+ *
+ * OUTPUTS: none
+ *
+ * SIDE EFFECTS: sets the image, heap and entry point fields
+ */
+static void image_init(PCB_t* pcb_ptr, uint32_t inode) {
+    uint8_t user_eip[4];
+
+    pcb_ptr->image_inode = inode;
+    pcb_ptr->image_length = inode_start[inode].data_length;
+    pcb_ptr->image_end = elf_image_end(inode, pcb_ptr->image_length);
+    pcb_ptr->heap_start = (pcb_ptr->image_end + FOUR_KB_SIZE - 1) & ~(FOUR_KB_SIZE - 1);
+    pcb_ptr->brk = pcb_ptr->heap_start;
+
+    //Bytes 24 to 27 of the executable. entry point
+    read_data(inode, 24, user_eip, 4); // Read eip from elf (location 24)
+    pcb_ptr->entry = *((uint32_t*)user_eip);
+}
+
+/*
+ * DESCRIPTION: Starts a new shell in place of a terminal's root shell
+ * that halted. The halting process' PCB, kernel stack, pid and page
+ * table are reused rather than freed and allocated again: we are still
+ * running on that stack, and the restart can't fail for lack of memory.
+ *
+ * INPUTS: pcb_ptr -- the root shell, its files already closed
+ *
+ * OUTPUTS: none, never returns
+ *
+ * SIDE EFFECTS: frees all of the old user memory, jumps to user mode
+ */
+static void restart_root_shell(PCB_t* pcb_ptr) {
+    uint8_t cmd[MAX_CMD_LENGTH] = "shell";
+    uint8_t argv[MAX_ARGUMENT_NUM][MAX_ARGS];
+    dentry_t dentry;
+
+    printf("Restarting with new shell...\n");
+
+    if (read_dentry_by_name(cmd, &dentry)) {
+        printf("No shell to restart, terminal %d stopped.\n", exec_terminal);
+        while (1) asm volatile("hlt");
+    }
+
+    // program, heap, stack, mmap and shared memory all go -- the new
+    // shell pages its image in from scratch
+    user_unmap_range(pcb_ptr->page_table, USER_MEM, USER_STACK_TOP);
+
+    // new root shell has no parent
+    curr_pcb = NULL;
+    memset(argv, 0, sizeof(argv));
+    pcb_init(pcb_ptr, cmd, argv, pcb_ptr->pid, 0);
+    image_init(pcb_ptr, dentry.inode_num);
+
+    pcb_ptr->is_shell = 1;
+    pcb_ptr->state = PROC_RUNNING;
+    terminals[exec_terminal].num_programs++;
+
+    curr_pcb = pcb_ptr;
+    terminals[exec_terminal].pcb = pcb_ptr;
+
+    // kernel entries start at the top of the stack again, whatever halt
+    // left on it is abandoned
+    tss.ss0 = KERNEL_DS;
+    tss.esp0 = pcb_ptr->kernel_stack;
+
+    context_switch(pcb_ptr->entry);
+}
+
 /*
  * DESCRIPTION: Halts the program and returns control to shell.
  *
@@ -17,48 +90,66 @@ int32_t halt(uint8_t status) {
 
     cli();
 
-    PCB_t* cur_pcb = terminals[exec_terminal].pcb;
+    PCB_t* cur_pcb = curr_pcb;
     PCB_t* prev_pcb = cur_pcb->parent_pcb;
 
     //close old files
     for(i = 0;i < 8; i++){
         if(cur_pcb->open_files[i].flags == FLAG_BUSY) {
 
-            close(i);
+            fd_release(i); // stdin/stdout too, they may be pipes
         }
 
         cur_pcb->open_files[i].file_op_table = null_fop;
     }
 
-    if (terminals[exec_terminal].num_programs > 0) {
-        process_flag[cur_pcb->pid] = 0;
+    // closes a program in current terminal
+    if (terminals[exec_terminal].num_programs > 0) terminals[exec_terminal].num_programs--;
+
+    orphan_children(cur_pcb);
+
+    // nobody is blocked in execute on an async (fork/spawn) child
+    if (cur_pcb->async) {
+        if (prev_pcb) {
+            // keep the PCB until the parent collects the status with wait
+            user_pt_destroy(cur_pcb->page_table);
+            cur_pcb->page_table = 0;
+            cur_pcb->exit_status = status;
+            cur_pcb->state = PROC_ZOMBIE;
+
+            wake_up(&prev_pcb->child_wait);
+        }
+        else {
+            // parent is gone, nobody will ever ask
+            cur_pcb->state = PROC_FREE;
+            release_process(cur_pcb);
+        }
 
-        // closes a program in current terminal
-        num_programs--;
-        terminals[exec_terminal].num_programs--;
+        // not runnable any more, so this never comes back. A freed stack
+        // is safe to use until then since interrupts are off.
+        schedule();
     }
 
+    cur_pcb->state = PROC_FREE;
+
     // check if the process to be halted is root shell process
-    if (terminals[exec_terminal].num_programs == 0) {
-        printf("Restarting with new shell...\n");
-        // execute shell
-        execute((uint8_t *)"shell");       
-    } 
+    if (prev_pcb == NULL) restart_root_shell(cur_pcb);
 
     // ---- restore parent paging -----------
-    uint32_t addr = EIGHT_MB_SIZE + FOUR_MB_SIZE * (prev_pcb -> pid);
-
-    switch_pd(addr);
-    flushTlb();
+    switch_pd(prev_pcb->page_table);
     
     //restore tss_esp0
     tss.esp0 = cur_pcb->tss_esp0;
 
+    // parent is runnable again, and continues on this time slice
     terminals[exec_terminal].pcb = prev_pcb;
+    curr_pcb = prev_pcb;
+    prev_pcb->state = PROC_RUNNING;
 
-    sti();
-
-    process_flag[cur_pcb->pid] = 0;
+    // we are still on the freed kernel stack until the jump below. That is
+    // fine as long as interrupts stay off (nothing can allocate it), they
+    // come back on with the iret to the parent.
+    release_process(cur_pcb);
 
     asm volatile("movl %0, %%eax;"
                  "movl %1, %%esp;"
@@ -74,137 +165,170 @@ int32_t halt(uint8_t status) {
 }
 
 /*
- * DESCRIPTION: Executes the given command
+ * DESCRIPTION: Loads a program and sets up its PCB without running it.
+ * The new process' parent is the currently running process (if any).
  *
- * INPUTS: a command/program to execute (ex: shell)
+ * INPUTS: command -- program name and arguments, terminal -- terminal the
+ * process runs on, pcb_out -- set to the new PCB on success
  * 
- * OUTPUTS: 0 upon success
+ * OUTPUTS: 0 upon success, -1 for invalid command, -2 for "exit",
+ * -3 if there is no memory (or pid) left for another process
  * 
- * SIDE EFFECTS: Executes the program, sets up new pcb, flushes TLB
+ * SIDE EFFECTS: Allocates a pid, kernel stack and page table, switches
+ * paging to the new process (it is left pointing there). The program is
+ * paged in on demand, see handle_page_fault.
  * 
  */
-int32_t execute(const uint8_t* command) {
-
-    cli();
-
-    // counter
-    int i;
+int32_t create_process(const uint8_t* command, int32_t terminal, PCB_t** pcb_out) {
 
     // local variables
     uint8_t parsed_cmd[MAX_CMD_LENGTH];
-    uint8_t argv[MAX_ARGUMENT_NUM][MAX_ARGS];
+    uint8_t (*argv)[MAX_ARGS];
     int32_t ret, num_args; 
 
     uint8_t ELF[4]; // used to check if executable
     int8_t filetype;
     dentry_t dentry;
 
-    int32_t pid;
+    int32_t pid, i;
 
-    uint8_t user_eip[4];
-    uint32_t eip;
+    uint32_t page_table;
 
-    uint32_t addr;
+    PCB_t* pcb_ptr;
 
     // --------------- Parse arguments -------------------
 
-    if (command == NULL) return -1; // NULL command
-
-    if(strlen((int8_t *) command) == 1) return 0;
-    if (command[0] == '\0' || command[0] == ' ') return -1; // invalid command
+    // off the kernel stack -- pcb_init keeps a copy
+    argv = kmalloc(MAX_ARGUMENT_NUM * MAX_ARGS);
+    if (!argv) return -3;
 
     ret = parse_cmd(command, parsed_cmd, argv);
 
-    if (ret == -1) return -1; // invalid command name
-
-    if (ret == -2) {
-        asm volatile( "call halt;");
-        // halt(0);
+    if (ret < 0) {
+        kfree(argv);
+        return ret; // invalid command name or exit
     }
 
-    num_args = (ret > -1) ? ret : 0; 
+    num_args = ret; 
 
     // -------------------- file type validation --------------------------
     
-    if (num_programs >= 6) { // max program number
-        printf("Maximum processes have been reached.\n");
-        return 0;
-    }
-    
     filetype = read_dentry_by_name(parsed_cmd, &dentry);
 
-    if (filetype == -1) return -1;
-
     // ensure ELF file -- read first 4 characters
-    filetype = read_data(dentry.inode_num, 0, ELF, 4);
-
-    if(filetype == -1) return -1;
+    if (filetype != -1) filetype = read_data(dentry.inode_num, 0, ELF, 4);
 
     // 0x7F is DEL char - see MP3 checkpoint 3 writeup for details on characters to validate
-    if (ELF[0] != 0x7F || ELF[1] != 'E' || ELF[2] != 'L' || ELF[3] != 'F') {
-        return -1; // not executable
+    if (filetype == -1 || ELF[0] != 0x7F || ELF[1] != 'E' || ELF[2] != 'L' || ELF[3] != 'F') {
+        kfree(argv);
+        return -1; // missing or not executable
     }
 
-    // -------------------- set up PID ---------------------------------
+    // ------------------ allocate memory and PID --------------------------
 
-    int pid_full = 1;
-    for (i = 0; i < 6; i++) {
-        if (!(process_flag[i])) {
-            process_flag[i] = 1;
-            pid = i;
-            pid_full = 0;
-            break;
-        }
+    // PCB at the bottom of an 8KB kernel stack
+    pcb_ptr = (PCB_t *)frame_alloc_contig(PCB_FRAMES, PCB_FRAMES);
+    if (!pcb_ptr) {
+        kfree(argv);
+        return -3;
     }
 
-    if (pid_full) {
-        printf("Maximum processes have been reached.\n");
-        return 0;
+    // page table for the 128MB region, pages are added on demand
+    page_table = user_pt_create();
+    if (!page_table) {
+        frame_free_contig((uint32_t)pcb_ptr, PCB_FRAMES);
+        kfree(argv);
+        return -3;
     }
 
-    //updates total program count
-    num_programs++;
-    terminals[exec_terminal].num_programs++;    
+    pid = pid_alloc(pcb_ptr);
+    if (pid < 0) {
+        user_pt_destroy(page_table);
+        frame_free_contig((uint32_t)pcb_ptr, PCB_FRAMES);
+        kfree(argv);
+        return -3;
+    }
 
-    //Bytes 24 to 27 of the executable. entry point
-    read_data(dentry.inode_num, 24, user_eip, 4); // Read eip from elf (location 24)
-    eip = *((uint32_t*)user_eip);
+    //updates terminal program count
+    terminals[terminal].num_programs++;    
 
     //------------------------------ set up paging ----------------------------------
     
-    addr = EIGHT_MB_SIZE + pid * FOUR_MB_SIZE;
-    switch_pd(addr);
-    flushTlb();
+    // no pages are mapped yet -- the page fault handler loads the image
+    // from the filesystem (and zero-fills the stack) as it is touched
+    switch_pd(page_table);
 
-    // -------------------- loads program into correct location ------------------------
-	
-    read_data(dentry.inode_num, 0, (uint8_t *) USER_PROGRAM_ADDR, inode_start[dentry.inode_num].data_length);
-    
     // -------------------- Set up PCB --------------
     
-    uint32_t temp_ebp, temp_esp;
+    pcb_init(pcb_ptr, parsed_cmd, argv, pid, num_args); 
+    kfree(argv);
 
-    // scheduler will set up shell if running on terminal first time
-    if (terminals[exec_terminal].pcb != NULL && terminals[exec_terminal].pcb->scheduled) {
-            
-            // if already scheduled to run
-            temp_esp = terminals[exec_terminal].pcb->user_esp;
-            temp_ebp = terminals[exec_terminal].pcb->user_ebp;
+    pcb_ptr->kernel_stack = (uint32_t)pcb_ptr + EIGHT_KB_SIZE;
+    pcb_ptr->page_table = page_table;
+    image_init(pcb_ptr, dentry.inode_num);
 
-            terminals[exec_terminal].pcb->scheduled = 0;
-        }
-    else {
-            // needs to get values from scheduler
-            temp_esp = 0;
-            temp_ebp = 0;
+    pcb_ptr->terminal = terminal;
+
+    // stdin and stdout come from the parent, so a shell can connect them
+    // to pipes (or back to the terminal) before starting a program
+    if (curr_pcb && curr_pcb->terminal == terminal) {
+        for (i = 0; i < 2; i++) {
+            if (curr_pcb->open_files[i].flags != FLAG_BUSY) continue;
+            pcb_ptr->open_files[i] = curr_pcb->open_files[i];
+            fd_ref(&pcb_ptr->open_files[i]);
         }
-    
+    }
+
+    if (strncmp("shell", (int8_t*)parsed_cmd, 5) == 0) { // is this a shell?
+        pcb_ptr->is_shell = 1;
+    } 
+
+    *pcb_out = pcb_ptr;
+
+    return 0;
+}
+
+/*
+ * DESCRIPTION: Executes the given command
+ *
+ * INPUTS: a command/program to execute (ex: shell)
+ * 
+ * OUTPUTS: 0 upon success
+ * 
+ * SIDE EFFECTS: Executes the program, sets up new pcb, flushes TLB
+ * 
+ */
+int32_t execute(const uint8_t* command) {
+
+    cli();
+
+    int32_t ret;
     PCB_t* pcb_ptr;
-    pcb_ptr = (PCB_t *)(EIGHT_MB_SIZE - (pid + 1) * EIGHT_KB_SIZE); 
-    pcb_init(pcb_ptr, parsed_cmd, argv, pid, num_args); 
 
-    pcb_ptr->user_ebp = temp_ebp;
-    pcb_ptr->user_esp = temp_esp;
+    // --------------- Parse arguments -------------------
+
+    if (command == NULL) return -1; // NULL command
+
+    if(strlen((int8_t *) command) == 1) return 0;
+    if (command[0] == '\0' || command[0] == ' ') return -1; // invalid command
+
+    // -------------------- load program ------------------------
+
+    ret = create_process(command, exec_terminal, &pcb_ptr);
+
+    if (ret == -2) {
+        asm volatile( "call halt;");
+        // halt(0);
+    }
+
+    if (ret == -3) {
+        printf("Maximum processes have been reached.\n");
+        return 0;
+    }
+
+    if (ret == -1) return -1;
+
+    // -------------------- Set up PCB --------------
 
     //save esp and ebp
 
@@ -214,20 +338,22 @@ int32_t execute(const uint8_t* command) {
             "
             :"=r"(pcb_ptr->parent_ebp), "=r"(pcb_ptr->parent_esp) );
 
-    terminals[exec_terminal].pcb = pcb_ptr;
+    // parent sleeps until child halts -- it is not in the run queue,
+    // the child takes over the rest of its time slice
+    if (curr_pcb) curr_pcb->state = PROC_WAITING;
 
-    if (strncmp("shell", (int8_t*)parsed_cmd, 5) == 0) { // is this a shell?
-        terminals[exec_terminal].pcb->is_shell = 1;
-    } 
+    pcb_ptr->state = PROC_RUNNING;
+    curr_pcb = pcb_ptr;
+    terminals[exec_terminal].pcb = pcb_ptr;
 
   //------------Prepare for context switch--------------------------------------------------
 
     //switching privilege level
     tss.ss0 = KERNEL_DS;
-    tss.esp0 = EIGHT_MB_SIZE - (EIGHT_KB_SIZE * terminals[exec_terminal].pcb->pid);
+    tss.esp0 = pcb_ptr->kernel_stack;
 
 
-    context_switch(eip); // Page fault here at stack
+    context_switch(pcb_ptr->entry); // Page fault here at stack
 
     asm volatile( "execute_return:" );
 
@@ -250,14 +376,14 @@ int32_t read(int32_t fd, void* buf, int32_t nbytes) {
     int32_t ret = 0;
  
     if (valid_fd(fd) == -1 || fd == 1 // valid fd check; don't want STDOUT (fd of 1)
-    || !buf || nbytes < 0 || terminals[exec_terminal].pcb->open_files[fd].flags != FLAG_BUSY) { 
+    || !buf || nbytes < 0 || curr_pcb->open_files[fd].flags != FLAG_BUSY) { 
         return -1;
     }
     
     // int32_t(*read_handler)(int32_t, void*, int32_t);
     
     // read_handler = (curr_pcb->open_files[fd].file_op_table[2]);
-    ret = terminals[exec_terminal].pcb->open_files[fd].file_op_table.read(fd, buf, nbytes);
+    ret = curr_pcb->open_files[fd].file_op_table.read(fd, buf, nbytes);
 
     return ret;
 }
@@ -278,11 +404,11 @@ int32_t write(int32_t fd, const void* buf, int32_t nbytes) {
     int32_t ret = 0;
  
     if (valid_fd(fd) == -1 || fd == 0 // valid fd check; don't want STDIN (fd of 0)
-    || !buf || nbytes < 0 || terminals[exec_terminal].pcb->open_files[fd].flags != FLAG_BUSY) { 
+    || !buf || nbytes < 0 || curr_pcb->open_files[fd].flags != FLAG_BUSY) { 
         return -1;
     }
     
-    ret = terminals[exec_terminal].pcb->open_files[fd].file_op_table.write(fd, buf, nbytes);
+    ret = curr_pcb->open_files[fd].file_op_table.write(fd, buf, nbytes);
 
     return ret;
 }
@@ -308,7 +434,7 @@ int32_t open(const uint8_t* filename) {
 
     if (dentry.filetype < 0 || dentry.filetype > 2) return -1; // invalid file type, should never happen
 
-    PCB_t* pcb_ptr = terminals[exec_terminal].pcb;
+    PCB_t* pcb_ptr = curr_pcb;
 
     // User file starts at index 2 (0 is STDIN, 1 is STDOUT), maximum of 8 files in PCB
     for (i = 2; i < 8; i++) {
@@ -327,7 +453,7 @@ int32_t open(const uint8_t* filename) {
                 pcb_ptr->open_files[i].file_op_table = (fop_t)filesys_fop;   //placeholder until fop is made
             }
 
-            terminals[exec_terminal].pcb->open_files[fd].file_op_table.open(filename);
+            curr_pcb->open_files[fd].file_op_table.open(filename);
 
             return i; /* return fd upon success*/
         }
@@ -353,11 +479,9 @@ int32_t open(const uint8_t* filename) {
 int32_t close(int32_t fd) {
 
     if (valid_fd(fd) == -1 || fd < 2) return -1; // either invalid fd or attempting to close STDIN/OUT
-    terminals[exec_terminal].pcb->open_files[fd].file_op_table.close(fd);
 
     // clear all entries in curr_pcb.open_files[fd] to 0
-    // curr_pcb->open_files[fd].flags = FLAG_FREE;
-    clear_fd(fd);
+    fd_release(fd);
 
     return 0;
 }
@@ -376,10 +500,10 @@ int32_t close(int32_t fd) {
  */
 int32_t getargs(uint8_t* buf, int32_t nbytes) {
 
-    uint8_t* argv = (uint8_t *) terminals[exec_terminal].pcb->argv;
+    uint8_t* argv = (uint8_t *) curr_pcb->argv;
 
     //If there are no arguments or invalid copy size
-    if ((terminals[exec_terminal].pcb->argv[0][0] == '\0') || nbytes <= 0) return -1;
+    if ((curr_pcb->argv[0][0] == '\0') || nbytes <= 0) return -1;
 
     // truncates argument if necessary
     nbytes = (nbytes > MAX_ARGS) ? MAX_ARGS : nbytes;
@@ -424,6 +548,453 @@ int32_t sigreturn(void) {
     return -1;
 }
 
+/*
+ * DESCRIPTION: Sets the base MLFQ level of the calling process (0 is the
+ * highest priority, NUM_LEVELS - 1 the lowest). The process is moved to
+ * that level now and is never boosted above it. Children started with
+ * execute inherit it.
+ *
+ * INPUTS: priority -- new base level
+ * 
+ * OUTPUTS: previous base level upon success, -1 for invalid level
+ * 
+ * SIDE EFFECTS: changes scheduling of the current process
+ */
+int32_t set_priority(int32_t priority) {
+    int32_t old;
+
+    if (priority < 0 || priority >= NUM_LEVELS) return -1;
+
+    old = curr_pcb->base_priority;
+
+    curr_pcb->base_priority = priority;
+    sched_set_level(curr_pcb, priority);
+
+    return old;
+}
+
+/*
+ * DESCRIPTION: Creates a copy of the calling process. The child gets a
+ * copy-on-write clone of the address space and the open files, and
+ * returns from the same syscall; it runs alongside the parent instead of
+ * blocking it like execute does.
+ *
+ * INPUTS: none
+ * 
+ * OUTPUTS: child's pid in the parent, 0 in the child, -1 upon failure
+ * 
+ * SIDE EFFECTS: allocates a PCB, kernel stack and page table, write
+ * protects the parent's pages, queues the child
+ */
+int32_t fork(void) {
+    PCB_t* child;
+    uint32_t page_table;
+    uint32_t* stack;
+    int32_t pid;
+    int i;
+
+    child = (PCB_t *)frame_alloc_contig(PCB_FRAMES, PCB_FRAMES);
+    if (!child) return -1;
+
+    pid = pid_alloc(child);
+    if (pid < 0) {
+        frame_free_contig((uint32_t)child, PCB_FRAMES);
+        return -1;
+    }
+
+    page_table = user_pt_clone(curr_pcb->page_table);
+    if (!page_table) {
+        pid_release(pid);
+        frame_free_contig((uint32_t)child, PCB_FRAMES);
+        return -1;
+    }
+
+    // same files, program image, terminal and priority
+    memcpy(child, curr_pcb, sizeof(PCB_t));
+
+    child->pid = pid;
+    child->parent_pcb = curr_pcb;
+    child->parent_pid = curr_pcb->pid;
+    child->parent_esp = 0;
+    child->parent_ebp = 0;
+    child->async = 1;
+    child->exit_status = 0;
+    child->child_wait.head = NULL;
+    child->child_wait.tail = NULL;
+    child->children = NULL;
+    child_link(curr_pcb, child);
+
+    child->kernel_stack = (uint32_t)child + EIGHT_KB_SIZE;
+    child->page_table = page_table;
+
+    child->next = NULL;
+    sched_set_level(child, child->base_priority);
+
+    // the child holds its own reference to open rtc files and pipes
+    for (i = 0; i < 8; i++) fd_ref(&child->open_files[i]);
+
+    terminals[child->terminal].num_programs++;
+
+    // child resumes at the end of this syscall, on a copy of our frame
+    stack = (uint32_t *)(child->kernel_stack - SYSCALL_FRAME_SIZE);
+    memcpy(stack, (void *)(curr_pcb->kernel_stack - SYSCALL_FRAME_SIZE), SYSCALL_FRAME_SIZE);
+
+    sched_new_context(child, stack, (uint32_t)fork_return);
+
+    return pid;
+}
+
+/*
+ * DESCRIPTION: Starts a program without waiting for it, unlike execute.
+ * The child runs alongside the caller on the same terminal; its status
+ * can be collected later with wait.
+ *
+ * INPUTS: command -- program name and arguments
+ * 
+ * OUTPUTS: child's pid upon success, -1 upon failure
+ * 
+ * SIDE EFFECTS: loads and queues the child
+ */
+int32_t spawn(const uint8_t* command) {
+    PCB_t* child;
+
+    if (command == NULL) return -1;
+
+    if (create_process(command, exec_terminal, &child) != 0) return -1;
+
+    // create_process left paging pointing at the child
+    switch_pd(curr_pcb->page_table);
+
+    child->async = 1;
+    child_link(curr_pcb, child);
+    sched_new_process(child, child->entry);
+
+    return child->pid;
+}
+
+/*
+ * DESCRIPTION: Waits for an async child (from fork or spawn) to halt and
+ * collects its status.
+ *
+ * INPUTS: pid -- child to wait for
+ * 
+ * OUTPUTS: the child's halt status, -1 if pid isn't an async child of
+ * the caller
+ * 
+ * SIDE EFFECTS: blocks until the child halts, then frees it
+ */
+int32_t wait(int32_t pid) {
+    PCB_t* child;
+    int32_t status;
+
+    if (pid < 0) return -1;
+
+    child = get_pcb(pid);
+    if (!child || child->parent_pcb != curr_pcb || !child->async) return -1;
+
+    cli();
+
+    // halt wakes us when one of our children becomes a zombie
+    while (child->state != PROC_ZOMBIE) sleep_on(&curr_pcb->child_wait);
+
+    status = child->exit_status;
+    release_process(child);
+
+    return status;
+}
+
+/*
+ * DESCRIPTION: Maps an open file read-only into the process, so it can be
+ * scanned in place instead of copied out with read. Mappings are placed
+ * below the stack, one under the other, and last until the process
+ * halts. Writing to the mapping changes only the process' copy.
+ *
+ * INPUTS: fd -- open regular file, start -- where to store the address
+ * of the mapping
+ *
+ * OUTPUTS: file size in bytes upon success, -1 for a bad fd or pointer,
+ * or if there is no room left
+ *
+ * SIDE EFFECTS: maps pages into the current page table
+ */
+int32_t mmap(int32_t fd, uint8_t** start) {
+    uint32_t addr = (uint32_t)start;
+    uint32_t length, base;
+
+    if (addr < USER_MEM || addr > USER_STACK_TOP - sizeof(uint8_t *)) return -1;
+
+    if (valid_fd(fd) == -1 || curr_pcb->open_files[fd].flags != FLAG_BUSY ||
+        curr_pcb->open_files[fd].file_op_table.read != file_read) return -1;
+
+    length = get_file_size(curr_pcb->open_files[fd].inode_num);
+    base = curr_pcb->mmap_base - ((length + FOUR_KB_SIZE - 1) & ~(FOUR_KB_SIZE - 1));
+
+    // don't run into the program image or heap
+    if (base > curr_pcb->mmap_base || base < curr_pcb->brk) return -1;
+
+    if (user_map_file(curr_pcb->page_table, base, curr_pcb->open_files[fd].inode_num, length)) return -1;
+
+    curr_pcb->mmap_base = base;
+    *start = (uint8_t *)base;
+
+    return length;
+}
+
+/*
+ * DESCRIPTION: Creates an empty file, which can then be opened and
+ * written (appended) to.
+ *
+ * INPUTS: filename -- name of the new file
+ *
+ * OUTPUTS: 0 upon success, -1 if the name is invalid or taken, or the
+ * filesystem is full
+ *
+ * SIDE EFFECTS: adds the file to the directory
+ */
+int32_t create(const uint8_t* filename) {
+    return fs_create(filename);
+}
+
+/*
+ * DESCRIPTION: Writes every block buffered by earlier writes back to the
+ * filesystem.
+ *
+ * INPUTS: none
+ *
+ * OUTPUTS: number of blocks written back
+ *
+ * SIDE EFFECTS: updates filesystem blocks
+ */
+int32_t flush(void) {
+    return bcache_flush();
+}
+
+/*
+ * DESCRIPTION: Reads as many entries of an open directory as fit in buf,
+ * with their type, inode and size (see dirent_t).
+ *
+ * INPUTS: fd -- open directory, buf -- buffer, nbytes -- its size
+ *
+ * OUTPUTS: bytes filled, 0 at the end of the directory, -1 for a bad fd
+ * or a buffer too small for the next entry
+ *
+ * SIDE EFFECTS: moves the directory position on
+ */
+int32_t getdents(int32_t fd, void* buf, int32_t nbytes) {
+    if (valid_fd(fd) == -1 || !buf || nbytes < 0 || curr_pcb->open_files[fd].flags != FLAG_BUSY ||
+        curr_pcb->open_files[fd].file_op_table.read != dir_read) {
+        return -1;
+    }
+
+    return dir_getdents(fd, buf, nbytes);
+}
+
+/*
+ * DESCRIPTION: Reads from an open file at a given offset, without using
+ * or moving its file position.
+ *
+ * INPUTS: fd -- open regular file, buf -- buffer, nbytes -- bytes to
+ * read, offset -- where in the file to start
+ *
+ * OUTPUTS: bytes read (0 at or past the end), -1 for a bad fd or buffer
+ *
+ * SIDE EFFECTS: fills buf
+ */
+int32_t pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset) {
+    if (valid_fd(fd) == -1 || !buf || nbytes < 0 || curr_pcb->open_files[fd].flags != FLAG_BUSY ||
+        curr_pcb->open_files[fd].file_op_table.read != file_read) {
+        return -1;
+    }
+
+    return pcache_read(curr_pcb->open_files[fd].inode_num, offset, buf, nbytes);
+}
+
+/*
+ * DESCRIPTION: Writes to an open file at a given offset, without using
+ * or moving its file position. The offset may be the end of the file to
+ * grow it, but not past it.
+ *
+ * INPUTS: fd -- open regular file, buf -- data, nbytes -- bytes to
+ * write, offset -- where in the file to start
+ *
+ * OUTPUTS: bytes written, -1 for a bad fd, buffer or offset, or if the
+ * filesystem is full
+ *
+ * SIDE EFFECTS: changes the file
+ */
+int32_t pwrite(int32_t fd, const void* buf, int32_t nbytes, uint32_t offset) {
+    if (valid_fd(fd) == -1 || !buf || nbytes < 0 || curr_pcb->open_files[fd].flags != FLAG_BUSY ||
+        curr_pcb->open_files[fd].file_op_table.write != file_write) {
+        return -1;
+    }
+
+    return write_data(curr_pcb->open_files[fd].inode_num, offset, buf, nbytes);
+}
+
+/*
+ * DESCRIPTION: Grows or shrinks the process' heap, which starts on the
+ * page after the program image. New heap pages are zero-filled when
+ * first touched; pages given back are unmapped.
+ *
+ * INPUTS: increment -- bytes to add to the heap (negative to give back)
+ *
+ * OUTPUTS: the old end of the heap, -1 if it would run into the mmap
+ * region or below its start
+ *
+ * SIDE EFFECTS: may unmap pages from the current page table
+ */
+int32_t sbrk(int32_t increment) {
+    uint32_t old = curr_pcb->brk;
+    uint32_t brk = old + increment;
+
+    if (increment > 0 && (brk < old || brk > curr_pcb->mmap_base)) return -1;
+    if (increment < 0 && (brk > old || brk < curr_pcb->heap_start)) return -1;
+
+    // pages wholly above the new end go
+    if (increment < 0) {
+        user_unmap_range(curr_pcb->page_table, (brk + FOUR_KB_SIZE - 1) & ~(FOUR_KB_SIZE - 1),
+                         (old + FOUR_KB_SIZE - 1) & ~(FOUR_KB_SIZE - 1));
+    }
+
+    curr_pcb->brk = brk;
+
+    return old;
+}
+
+/*
+ * DESCRIPTION: Gets a shared memory segment, creating it zero-filled if
+ * no process has yet. Processes that use the same key share it.
+ *
+ * INPUTS: key -- segment name, size -- bytes needed (at most 64KB)
+ *
+ * OUTPUTS: segment id for shmat, -1 if size is bad or larger than the
+ * existing segment, or no segment or memory is left
+ *
+ * SIDE EFFECTS: may allocate frames
+ */
+int32_t shmget(uint32_t key, uint32_t size) {
+    return shm_get(key, size);
+}
+
+/*
+ * DESCRIPTION: Maps a shared memory segment into the process, writable.
+ * Every process attached sees the same memory, as does a forked child.
+ * The mapping lasts until the process halts. Like mmap, the segment
+ * bounds the heap from above.
+ *
+ * INPUTS: id -- segment from shmget, addr -- page aligned address to map
+ * it at, between the heap and the stack, or NULL to put it below the
+ * last mmap
+ *
+ * OUTPUTS: address of the segment, -1 for a bad id or address, or if
+ * something is already mapped there
+ *
+ * SIDE EFFECTS: maps pages into the current page table
+ */
+int32_t shmat(int32_t id, uint8_t* addr) {
+    uint32_t base = (uint32_t)addr;
+    uint32_t size = shm_size(id);
+
+    if (!size) return -1;
+
+    if (base == 0) base = curr_pcb->mmap_base - size;
+
+    if (base & (FOUR_KB_SIZE - 1)) return -1;
+    if (base < curr_pcb->brk || base > USER_MMAP_TOP || size > USER_MMAP_TOP - base) return -1;
+
+    if (shm_attach(id, curr_pcb->page_table, base)) return -1;
+
+    if (base < curr_pcb->mmap_base) curr_pcb->mmap_base = base;
+
+    return base;
+}
+
+/*
+ * DESCRIPTION: Opens a pipe. Bytes written to the write end are read
+ * from the read end, in order. Reads block until there is data, writes
+ * block while the pipe is full.
+ *
+ * INPUTS: fds -- two ints, set to the read end and the write end
+ *
+ * OUTPUTS: 0 upon success, -1 for a bad pointer, or if there aren't two
+ * free fds or memory is full
+ *
+ * SIDE EFFECTS: takes two fds
+ */
+int32_t pipe(int32_t* fds) {
+    uint32_t addr = (uint32_t)fds;
+
+    if (addr < USER_MEM || addr > USER_STACK_TOP - 2 * sizeof(int32_t)) return -1;
+
+    return pipe_create(fds);
+}
+
+/*
+ * DESCRIPTION: Makes newfd refer to the same open file as oldfd, closing
+ * whatever newfd had open first. Either may be stdin or stdout, which is
+ * how a shell connects a program to a pipe and back to the terminal.
+ *
+ * INPUTS: oldfd -- open fd, newfd -- fd to replace
+ *
+ * OUTPUTS: newfd, -1 if oldfd isn't open or newfd is out of range
+ *
+ * SIDE EFFECTS: may close newfd
+ */
+int32_t dup2(int32_t oldfd, int32_t newfd) {
+    if (valid_fd(oldfd) == -1 || newfd < 0 || newfd >= 8) return -1;
+
+    if (oldfd == newfd) return newfd;
+
+    fd_release(newfd);
+
+    curr_pcb->open_files[newfd] = curr_pcb->open_files[oldfd];
+    fd_ref(&curr_pcb->open_files[newfd]);
+
+    return newfd;
+}
+
+/*
+ * DESCRIPTION: Tells whether an fd is the terminal, e.g. so a program can
+ * tell that its input comes from a pipe.
+ *
+ * INPUTS: fd -- open fd
+ *
+ * OUTPUTS: 1 for the terminal, 0 for anything else, -1 if fd isn't open
+ *
+ * SIDE EFFECTS: none
+ */
+int32_t isatty(int32_t fd) {
+    if (valid_fd(fd) == -1) return -1;
+
+    return curr_pcb->open_files[fd].file_op_table.open == terminal_open;
+}
+
+/*
+ * DESCRIPTION: Reads or writes a pipe, whichever end fd is, moving whole
+ * pages of a page aligned buf by remapping them rather than copying.
+ * Pages written are taken from the writer (zeroed, unless shared and so
+ * copied), pages read replace what buf had. For bulk data between
+ * pipeline stages.
+ *
+ * INPUTS: fd -- either end of a pipe, buf -- buffer, nbytes -- its length
+ *
+ * OUTPUTS: bytes moved as for read/write, -1 if fd isn't a pipe or buf
+ * is outside user memory
+ *
+ * SIDE EFFECTS: remaps pages of the process, may sleep
+ */
+int32_t vmsplice(int32_t fd, void* buf, int32_t nbytes) {
+    uint32_t addr = (uint32_t)buf;
+
+    if (valid_fd(fd) == -1 || !pipe_fd(&curr_pcb->open_files[fd]) || nbytes < 0) return -1;
+
+    if (addr < USER_MEM || addr > USER_STACK_TOP || (uint32_t)nbytes > USER_STACK_TOP - addr) return -1;
+
+    if (curr_pcb->open_files[fd].file_op_table.read == pipe_read) return pipe_splice_read(fd, buf, nbytes);
+
+    return pipe_splice_write(fd, buf, nbytes);
+}
+
 // /*
 //  * DESCRIPTION: clears open files' file descriptors
 //  *
@@ -16,6 +16,11 @@
 #include "rtc.h"
 #include "paging.h"
 #include "syscall_help.h"
+#include "scheduler.h"
+#include "bcache.h"
+#include "pcache.h"
+#include "kmalloc.h"
+#include "shm.h"
 
 // Assembly linkage for syscalls
 void syscall_wrap(void);
@@ -34,9 +39,36 @@ int32_t vidmap(uint8_t **screen_start);
 // Extra Credit -- returns failure (-1) for now
 int32_t set_handler(int32_t signum, void *handler_address);
 int32_t sigreturn(void);
+// Scheduling
+int32_t set_priority(int32_t priority);
+int32_t fork(void);
+int32_t spawn(const uint8_t* command);
+int32_t wait(int32_t pid);
+// Filesystem
+int32_t mmap(int32_t fd, uint8_t** start);
+int32_t create(const uint8_t* filename);
+int32_t flush(void);
+int32_t getdents(int32_t fd, void* buf, int32_t nbytes);
+int32_t pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset);
+int32_t pwrite(int32_t fd, const void* buf, int32_t nbytes, uint32_t offset);
+// Memory
+int32_t sbrk(int32_t increment);
+int32_t shmget(uint32_t key, uint32_t size);
+int32_t shmat(int32_t id, uint8_t* addr);
+// Pipes
+int32_t pipe(int32_t* fds);
+int32_t dup2(int32_t oldfd, int32_t newfd);
+int32_t isatty(int32_t fd);
+int32_t vmsplice(int32_t fd, void* buf, int32_t nbytes);
 
 void context_switch(uint32_t entry);
+// Assembly linkage -- a forked child returns from the syscall here
+void fork_return(void);
+
+// iret frame + registers syscall_wrap saves, at the top of the kernel stack
+#define SYSCALL_FRAME_SIZE 56
 // helpers
+int32_t create_process(const uint8_t* command, int32_t terminal, PCB_t** pcb_out);
 // void clearFd(PCB_entry_t* openFd);
 // int32_t clearProcess(int32_t pid);
 
@@ -84,6 +84,8 @@ void init_terminal() {
          terminals[i].y = 0;
          terminals[i].buffer_length = 0;
          terminals[i].num_programs = 0;
+         terminals[i].read_wait.head = NULL;
+         terminals[i].read_wait.tail = NULL;
          terminals[i].vid_mem = VIDEO_ADDRESS + (i + 1) * FOUR_KB_SIZE; // offset per terminal
 	}
 }
@@ -102,7 +104,7 @@ void switch_terminal(int32_t terminal_num) {
     if (old_terminal == terminal_num) return;
 
 
-    if (terminal_num < 0 || terminal_num > 2 || num_programs > 6)  {// 6 programs total
+    if (terminal_num < 0 || terminal_num > 2)  {
         return;
     }
 
@@ -183,11 +185,11 @@ int private_terminal_read(char *data, int size)
         terminals[exec_terminal].buffer[i] = ' ';
     }
 
-    sti(); // waits for user input
+    cli(); // sleeps until user input -- keyboard handler wakes us
 
-    while(terminals[exec_terminal].buffer_length < MAX_BUF_SIZE - 1 && !enter_pressed[exec_terminal]);
-
-    cli();
+    while(terminals[exec_terminal].buffer_length < MAX_BUF_SIZE - 1 && !enter_pressed[exec_terminal]) {
+        sleep_on(&terminals[exec_terminal].read_wait);
+    }
 
     // extra +1 for newline with terminal write
     bytes_read = terminals[exec_terminal].buffer_length + 1;
@@ -259,6 +261,7 @@ void buffer_char(char data)
         {
             terminals[disp_terminal].buffer[terminals[disp_terminal].buffer_length] = '\n';
         }
+        wake_up(&terminals[disp_terminal].read_wait);
         break;
     case '\b': // backspace
         if (terminals[disp_terminal].buffer_length > 0)
@@ -280,6 +283,10 @@ void buffer_char(char data)
         {
             terminals[disp_terminal].buffer_length++;
         }
+
+        // buffer full also ends a read
+        if (terminals[disp_terminal].buffer_length >= MAX_BUF_SIZE - 1)
+            wake_up(&terminals[disp_terminal].read_wait);
         break;
     }
 }
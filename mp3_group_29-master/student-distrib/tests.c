@@ -6,6 +6,11 @@
 #include "terminal.h"
 #include "rtc.h"
 #include "syscalls.h"
+#include "bcache.h"
+#include "pcache.h"
+#include "kmalloc.h"
+#include "shm.h"
+#include "pipe.h"
 
 #define PASS 1
 #define FAIL 0
@@ -106,8 +111,9 @@ int paging_test(){
 	}
 
 	// checks if uninitialized entries in Directory return null for addresses
+	// (everything below the user page maps physical memory now)
 	asm volatile ("mov %%cr3,%0" : "=r"(tester));
-    tester = ((uint32_t*)tester)[3]&0xFFFFF000;
+    tester = ((uint32_t*)tester)[USER_PAGE + 2]&0xFFFFF000;
     if (tester != NULL){
         printf("paging test dereferencing fail");
         return FAIL;
@@ -566,6 +572,540 @@ int syscall_interrupt_test()
 
 /* Checkpoint 5 tests */
 
+#define TLB_BENCH_ITERS 1000
+
+static volatile uint32_t tlb_bench_sink;
+
+/* Times TLB_BENCH_ITERS paging switches, see tlb_benchmark */
+static uint32_t tlb_bench_switches(){
+	uint32_t start, i;
+
+	start = rdtsc();
+	for (i = 0; i < TLB_BENCH_ITERS; i++) {
+		flushTlb();					// what switch_pd does
+		set_vidmem(exec_terminal);
+
+		// kernel pages touched on the way back to the process
+		tlb_bench_sink += *(volatile uint32_t*)&tss;
+		tlb_bench_sink += *(volatile uint32_t*)page_directory;
+		tlb_bench_sink += *(volatile uint32_t*)VIDEO_ADDRESS;
+		tlb_bench_sink += *(volatile uint32_t*)EIGHT_MB_SIZE;
+	}
+
+	return (rdtsc() - start) / TLB_BENCH_ITERS;
+}
+
+/* TLB Benchmark
+ *
+ * Measures the paging part of a context switch (cr3 reload, video
+ * remap, refilling the kernel's TLB entries) with global kernel pages,
+ * and again with CR4.PGE turned off, which is how every switch behaved
+ * before kernel pages were global.
+ * Inputs: None
+ * Outputs: PASS
+ * Side Effects: Prints average cycles per switch
+ * Coverage: Global pages, invlpg
+ * Files: paging.h/c, paging_asm.S
+ */
+int tlb_benchmark(){
+	TEST_HEADER;
+	uint32_t flags, cr4, global, no_global;
+
+	cli_and_save(flags);
+
+	global = tlb_bench_switches();
+
+	asm volatile ("mov %%cr4,%0" : "=r"(cr4));
+	asm volatile ("mov %0,%%cr4" : : "r"(cr4 & ~CR4_PGE) : "memory");
+
+	no_global = tlb_bench_switches();
+
+	asm volatile ("mov %0,%%cr4" : : "r"(cr4) : "memory");
+
+	restore_flags(flags);
+
+	printf("cycles per switch: %u with global pages, %u without\n", global, no_global);
+
+	return PASS;
+}
+
+#define DENTRY_BENCH_ITERS 100
+
+/* Directory lookup the way read_dentry_by_name did it before the index */
+static int32_t dentry_scan(const uint8_t* fname, dentry_t* dentry){
+	uint32_t i;
+
+	for (i = 0; i < boot_block->dir_entries; i++) {
+		if (strncmp((int8_t*)fname, boot_block->d[i].filename, MAX_NAME_LENGTH) == 0) {
+			*dentry = boot_block->d[i];
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/* Dentry Lookup Benchmark
+ *
+ * Looks up every file in the directory, plus one missing name, through
+ * the hashed index and through a linear scan. Both must find the same
+ * dentries.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Prints average cycles per lookup
+ * Coverage: read_dentry_by_name
+ * Files: filesys.h/c
+ */
+int dentry_lookup_benchmark(){
+	TEST_HEADER;
+	uint8_t name[MAX_NAME_LENGTH + 1];
+	dentry_t hashed, scanned;
+	uint32_t i, n, start, hash_cycles, scan_cycles;
+	int result = PASS;
+
+	hash_cycles = scan_cycles = 0;
+
+	for (i = 0; i <= boot_block->dir_entries; i++) {
+		// last round looks up a name that isn't there
+		if (i == boot_block->dir_entries) {
+			strcpy((int8_t*)name, "no_such_file");
+		} else {
+			strncpy((int8_t*)name, boot_block->d[i].filename, MAX_NAME_LENGTH);
+			name[MAX_NAME_LENGTH] = '\0';
+		}
+
+		if (read_dentry_by_name(name, &hashed) != dentry_scan(name, &scanned) ||
+			(i < boot_block->dir_entries && hashed.inode_num != scanned.inode_num)) {
+			printf("mismatch on %s\n", name);
+			result = FAIL;
+		}
+
+		start = rdtsc();
+		for (n = 0; n < DENTRY_BENCH_ITERS; n++) read_dentry_by_name(name, &hashed);
+		hash_cycles += rdtsc() - start;
+
+		start = rdtsc();
+		for (n = 0; n < DENTRY_BENCH_ITERS; n++) dentry_scan(name, &scanned);
+		scan_cycles += rdtsc() - start;
+	}
+
+	n = (boot_block->dir_entries + 1) * DENTRY_BENCH_ITERS;
+	printf("cycles per lookup: %u hashed, %u scanned\n", hash_cycles / n, scan_cycles / n);
+
+	return result;
+}
+
+
+#define APPEND_BENCH_CHUNK	64
+#define APPEND_BENCH_COUNT	256		// 16KB per run
+
+/* Appends APPEND_BENCH_COUNT chunks to a new file, flushing the buffer
+ * cache after every append or once at the end. Returns cycles per KB,
+ * 0 if the data didn't read back. */
+static uint32_t fs_append_run(const int8_t* name, int write_through){
+	uint8_t chunk[APPEND_BENCH_CHUNK];
+	uint8_t check[APPEND_BENCH_CHUNK];
+	dentry_t dentry;
+	uint32_t start, cycles, i, j;
+
+	if (fs_create((uint8_t*)name) != 0 || read_dentry_by_name((uint8_t*)name, &dentry) != 0) return 0;
+
+	start = rdtsc();
+	for (i = 0; i < APPEND_BENCH_COUNT; i++) {
+		for (j = 0; j < APPEND_BENCH_CHUNK; j++) chunk[j] = i + j;
+
+		if (write_data(dentry.inode_num, i * APPEND_BENCH_CHUNK, chunk, APPEND_BENCH_CHUNK) != APPEND_BENCH_CHUNK) return 0;
+		if (write_through) bcache_flush();
+	}
+	bcache_flush();
+	cycles = rdtsc() - start;
+
+	// read it all back
+	if (get_file_size(dentry.inode_num) != APPEND_BENCH_COUNT * APPEND_BENCH_CHUNK) return 0;
+
+	for (i = 0; i < APPEND_BENCH_COUNT; i++) {
+		read_data(dentry.inode_num, i * APPEND_BENCH_CHUNK, check, APPEND_BENCH_CHUNK);
+		for (j = 0; j < APPEND_BENCH_CHUNK; j++) {
+			if (check[j] != (uint8_t)(i + j)) return 0;
+		}
+	}
+
+	return cycles / (APPEND_BENCH_COUNT * APPEND_BENCH_CHUNK / 1024);
+}
+
+/* Append Benchmark
+ *
+ * Appends to a new file in small chunks through the buffer cache, and
+ * again writing every chunk straight through. Both files must read back
+ * what was written.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Creates two files, prints cycles per KB appended
+ * Coverage: fs_create, write_data, buffer cache
+ * Files: filesys.h/c, bcache.h/c
+ */
+int fs_append_benchmark(){
+	TEST_HEADER;
+	uint32_t cached, through;
+
+	cached = fs_append_run("append_bench_cached", 0);
+	through = fs_append_run("append_bench_through", 1);
+
+	if (!cached || !through) return FAIL;
+
+	printf("cycles per KB appended: %u write-back, %u write-through\n", cached, through);
+
+	return PASS;
+}
+
+
+/* Mapped Block Test
+ *
+ * Writing a block a process maps moves the file to a new block; once
+ * the mapping is gone the block is written in place again (and could be
+ * reused), rather than staying pinned.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Creates a file
+ * Coverage: file_block_addr, fs_block_map/unmap, write_data
+ * Files: filesys.h/c, paging.h/c
+ */
+int block_map_test(){
+	TEST_HEADER;
+	static uint8_t page[BLOCK_SIZE];
+	dentry_t dentry;
+	uint32_t pt, addr, moved;
+	int result = PASS;
+
+	if (fs_create((uint8_t*)"block_map_test") != 0 || read_dentry_by_name((uint8_t*)"block_map_test", &dentry) != 0) return FAIL;
+	if (write_data(dentry.inode_num, 0, page, BLOCK_SIZE) != BLOCK_SIZE) return FAIL;
+
+	// an image that isn't page aligned can't map blocks at all
+	if (!(addr = file_block_addr(dentry.inode_num, 0))) return PASS;
+
+	pt = user_pt_create();
+	if (!pt || user_map_file(pt, USER_MEM, dentry.inode_num, BLOCK_SIZE) != 0) return FAIL;
+
+	write_data(dentry.inode_num, 0, (uint8_t*)"x", 1);
+	moved = file_block_addr(dentry.inode_num, 0);
+	if (moved == addr || *(uint8_t *)addr != 0) result = FAIL;
+
+	user_pt_destroy(pt);
+
+	write_data(dentry.inode_num, 0, (uint8_t*)"y", 1);
+	bcache_flush();
+	if (file_block_addr(dentry.inode_num, 0) != moved || *(uint8_t *)moved != 'y') result = FAIL;
+
+	return result;
+}
+
+#define READAHEAD_BENCH_CHUNK	512
+
+/* Read-ahead Test
+ *
+ * Reads the largest file in small chunks through the page cache, front
+ * to back, checking every chunk against read_data. Past the first page
+ * read-ahead should have every page in the cache before it is needed.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Prints the page cache counters for the read
+ * Coverage: pcache_read, sequential detection, read-ahead
+ * Files: pcache.h/c, filesys.h/c
+ */
+int pcache_readahead_test(){
+	TEST_HEADER;
+	uint8_t chunk[READAHEAD_BENCH_CHUNK];
+	uint8_t check[READAHEAD_BENCH_CHUNK];
+	pcache_stats_t before, after;
+	dentry_t dentry;
+	uint32_t i, j, inode = 0, size = 0;
+	int32_t n;
+
+	for (i = 0; read_dentry_by_index(i, &dentry) == 0; i++) {
+		if (dentry.filetype == FILE_ACCESS && (uint32_t)get_file_size(dentry.inode_num) > size) {
+			inode = dentry.inode_num;
+			size = get_file_size(inode);
+		}
+	}
+	if (size <= BLOCK_SIZE) return FAIL;
+
+	// nothing of the file cached yet
+	pcache_invalidate(inode, 0);
+	pcache_stats(&before);
+
+	for (i = 0; i < size; i += n) {
+		n = pcache_read(inode, i, chunk, READAHEAD_BENCH_CHUNK);
+		if (n <= 0 || read_data(inode, i, check, READAHEAD_BENCH_CHUNK) != n) return FAIL;
+
+		for (j = 0; j < (uint32_t)n; j++) {
+			if (chunk[j] != check[j]) return FAIL;
+		}
+	}
+
+	pcache_stats(&after);
+	printf("%u byte file: %u hits, %u misses, %u pages read ahead\n", size,
+		after.hits - before.hits, after.misses - before.misses, after.readahead - before.readahead);
+
+	if (after.misses - before.misses > 1) return FAIL;
+
+	return PASS;
+}
+
+
+#define KMALLOC_TEST_OBJECTS	256
+
+/* kmalloc Test
+ *
+ * Allocates objects of sizes across every size class and some large
+ * ones, fills each with its own pattern, checks none was overwritten,
+ * then frees them all. The heap must end up holding no more frames
+ * than it started with.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Prints each cache's statistics while everything is
+ * allocated
+ * Coverage: kmalloc, kfree, kmalloc_stats
+ * Files: kmalloc.h/c
+ */
+int kmalloc_test(){
+	TEST_HEADER;
+	static uint8_t* objs[KMALLOC_TEST_OBJECTS];
+	kmalloc_stats_t stats;
+	uint32_t i, j, size, frames, waste;
+	int result = PASS;
+
+	frames = frames_free();
+
+	for (i = 0; i < KMALLOC_TEST_OBJECTS; i++) {
+		// 1 byte up to 2 pages, mostly small
+		size = (i % 16 == 15) ? i * 31 : (i * 7) % KMALLOC_MAX_SIZE + 1;
+
+		objs[i] = kmalloc(size);
+		if (!objs[i] || ((uint32_t)objs[i] & (KMALLOC_MIN_SIZE - 1))) return FAIL;
+		memset(objs[i], i, size);
+	}
+
+	for (i = 0; i < KMALLOC_TEST_OBJECTS; i++) {
+		size = (i % 16 == 15) ? i * 31 : (i * 7) % KMALLOC_MAX_SIZE + 1;
+		for (j = 0; j < size; j++) {
+			if (objs[i][j] != (uint8_t)i) result = FAIL;
+		}
+	}
+
+	for (i = 0; i <= KMALLOC_LARGE; i++) {
+		kmalloc_stats(i, &stats);
+		waste = stats.allocs ? stats.object_size - stats.bytes / stats.allocs : 0;
+		printf("%u: %u slabs, %u/%u in use, %u allocs, %u B rounding waste\n", stats.object_size,
+			stats.slabs, stats.in_use, stats.objects, stats.allocs, (i == KMALLOC_LARGE) ? 0 : waste);
+	}
+
+	for (i = 0; i < KMALLOC_TEST_OBJECTS; i++) kfree(objs[i]);
+
+	if (frames_free() != frames) result = FAIL;
+
+	return result;
+}
+
+
+#define SHM_TEST_KEY	0x5348	// "SH"
+
+/* Shared Memory Test
+ *
+ * Gets a two page segment and attaches it to two fresh page tables,
+ * which must map the same frames, writable. Destroying the page tables
+ * must leave only the segment's own references.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Leaves the (unattached) segment behind
+ * Coverage: shm_get, shm_attach, user_map_frames, user_pt_destroy
+ * Files: shm.h/c, paging.h/c
+ */
+int shm_test(){
+	TEST_HEADER;
+	uint32_t pt[2], frame, idx, i;
+	int32_t id;
+	int result = PASS;
+
+	id = shm_get(SHM_TEST_KEY, FOUR_KB_SIZE + 1);
+	if (id < 0 || shm_size(id) != 2 * FOUR_KB_SIZE) return FAIL;
+
+	// same key finds the same segment, unless it's too small
+	if (shm_get(SHM_TEST_KEY, 1) != id || shm_get(SHM_TEST_KEY, 3 * FOUR_KB_SIZE) != -1) return FAIL;
+
+	pt[0] = user_pt_create();
+	pt[1] = user_pt_create();
+	if (!pt[0] || !pt[1]) return FAIL;
+
+	idx = (USER_MMAP_TOP - 2 * FOUR_KB_SIZE - USER_MEM) / FOUR_KB_SIZE;
+	for (i = 0; i < 2; i++) {
+		if (shm_attach(id, pt[i], USER_MMAP_TOP - 2 * FOUR_KB_SIZE) != 0) result = FAIL;
+	}
+	if (shm_attach(id, pt[0], USER_MMAP_TOP - 2 * FOUR_KB_SIZE) != -1) result = FAIL;
+
+	for (i = 0; i < 2; i++) {
+		frame = ((uint32_t *)pt[0])[idx + i];
+		if (frame != ((uint32_t *)pt[1])[idx + i] || !(frame & PTE_SHM) || !(frame & READ_WRITE)) result = FAIL;
+		if (frame_refcount(frame & ~(FOUR_KB_SIZE - 1)) != 3) result = FAIL;
+	}
+
+	frame = ((uint32_t *)pt[0])[idx] & ~(FOUR_KB_SIZE - 1);
+	user_pt_destroy(pt[0]);
+	user_pt_destroy(pt[1]);
+
+	if (frame_refcount(frame) != 1) result = FAIL;
+
+	return result;
+}
+
+
+/* Pipe Test
+ *
+ * Data written to a pipe comes out of the read end in order. Writing
+ * with every read end closed fails; reading with every write end closed
+ * drains what is left, then returns 0. Closing both ends frees the pipe.
+ * Needs a process with two free fds.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: pipe_create, pipe_read, pipe_write, pipe_close, close
+ * Files: pipe.h/c, syscalls.h/c
+ */
+int pipe_test(){
+	TEST_HEADER;
+	int32_t fds[2];
+	uint8_t buf[16];
+	uint32_t frames = frames_free();
+	int result = PASS;
+
+	if (pipe_create(fds) != 0) return FAIL;
+
+	if (pipe_write(fds[1], "hello", 5) != 5) result = FAIL;
+	if (pipe_read(fds[0], buf, sizeof(buf)) != 5 || strncmp((int8_t *)buf, "hello", 5)) result = FAIL;
+
+	close(fds[0]);
+	if (pipe_write(fds[1], "x", 1) != -1) result = FAIL;
+	close(fds[1]);
+
+	if (pipe_create(fds) != 0) return FAIL;
+
+	if (pipe_write(fds[1], "abc", 3) != 3) result = FAIL;
+	close(fds[1]);
+	if (pipe_read(fds[0], buf, 2) != 2 || pipe_read(fds[0], buf, 2) != 1 || buf[0] != 'c') result = FAIL;
+	if (pipe_read(fds[0], buf, 2) != 0) result = FAIL;
+	close(fds[0]);
+
+	if (frames_free() != frames) result = FAIL;
+
+	return result;
+}
+
+#define SPLICE_TEST_VA	(USER_MEM + 4 * FOUR_KB_SIZE)
+
+/* Page Splice Test
+ *
+ * Takes a page from one page table and gives it to another, as a pipe
+ * splice does. The frame itself must move, not a copy of it; the first
+ * table is left with a fresh zeroed page and the frame the second table
+ * had is freed.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: user_page_take, user_page_give
+ * Files: paging.h/c
+ */
+int splice_remap_test(){
+	TEST_HEADER;
+	uint32_t pt[2], frame, moved, idx;
+	uint32_t frames = frames_free();
+	int result = PASS;
+
+	pt[0] = user_pt_create();
+	pt[1] = user_pt_create();
+	if (!pt[0] || !pt[1]) return FAIL;
+
+	idx = (SPLICE_TEST_VA - USER_MEM) / FOUR_KB_SIZE;
+
+	frame = user_map_page(pt[0], SPLICE_TEST_VA);
+	if (!frame || !user_map_page(pt[1], SPLICE_TEST_VA)) return FAIL;
+	*(uint32_t *)frame = 0x391;
+
+	moved = user_page_take(pt[0], SPLICE_TEST_VA);
+	if (moved != frame || *(uint32_t *)moved != 0x391) result = FAIL;
+	if ((((uint32_t *)pt[0])[idx] & ~(FOUR_KB_SIZE - 1)) == frame) result = FAIL;
+	if (*(uint32_t *)(((uint32_t *)pt[0])[idx] & ~(FOUR_KB_SIZE - 1)) != 0) result = FAIL;
+
+	if (user_page_give(pt[1], SPLICE_TEST_VA, moved) != 0) result = FAIL;
+	if ((((uint32_t *)pt[1])[idx] & ~(FOUR_KB_SIZE - 1)) != frame) result = FAIL;
+	if (((uint32_t *)pt[1])[idx] & READ_WRITE) result = FAIL;
+	if (frame_refcount(frame) != 1) result = FAIL;
+
+	user_pt_destroy(pt[0]);
+	user_pt_destroy(pt[1]);
+
+	if (frames_free() != frames) result = FAIL;
+
+	return result;
+}
+
+#define COW_TEST_VA	(USER_MEM + 8 * FOUR_KB_SIZE)
+
+/* Copy-on-write Fork Test
+ *
+ * Clones a page table with one private page, as fork does. Both tables
+ * must map the frame read-only and copy-on-write, with a reference each.
+ * A write fault in the clone gives it a private copy while the original
+ * keeps the frame; a write fault in the original, now the only user,
+ * just makes the frame writable again. Destroying both frees everything.
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: user_pt_clone, user_cow_page, user_pt_destroy
+ * Files: paging.h/c, frame.h/c
+ */
+int cow_fork_test(){
+	TEST_HEADER;
+	uint32_t pt[2], frame, copy, idx, i;
+	uint32_t frames = frames_free();
+	int result = PASS;
+
+	pt[0] = user_pt_create();
+	if (!pt[0]) return FAIL;
+
+	idx = (COW_TEST_VA - USER_MEM) / FOUR_KB_SIZE;
+
+	frame = user_map_page(pt[0], COW_TEST_VA);
+	if (!frame) return FAIL;
+	*(uint32_t *)frame = 0x391;
+
+	pt[1] = user_pt_clone(pt[0]);
+	if (!pt[1]) return FAIL;
+
+	for (i = 0; i < 2; i++) {
+		if ((((uint32_t *)pt[i])[idx] & ~(FOUR_KB_SIZE - 1)) != frame) result = FAIL;
+		if (!(((uint32_t *)pt[i])[idx] & PTE_COW) || (((uint32_t *)pt[i])[idx] & READ_WRITE)) result = FAIL;
+	}
+	if (frame_refcount(frame) != 2) result = FAIL;
+
+	// the clone writes first: it gets a copy, the original keeps the frame
+	if (user_cow_page(pt[1], COW_TEST_VA) != 0) result = FAIL;
+	copy = ((uint32_t *)pt[1])[idx] & ~(FOUR_KB_SIZE - 1);
+	if (copy == frame || *(uint32_t *)copy != 0x391) result = FAIL;
+	if (!(((uint32_t *)pt[1])[idx] & READ_WRITE) || (((uint32_t *)pt[1])[idx] & PTE_COW)) result = FAIL;
+	if (frame_refcount(frame) != 1) result = FAIL;
+
+	*(uint32_t *)copy = 0x392;
+	if (*(uint32_t *)frame != 0x391) result = FAIL;
+
+	// the original is the only user left, no copy needed
+	if (user_cow_page(pt[0], COW_TEST_VA) != 0) result = FAIL;
+	if (((uint32_t *)pt[0])[idx] != (frame | USER | READ_WRITE | PRESENT)) result = FAIL;
+
+	user_pt_destroy(pt[0]);
+	user_pt_destroy(pt[1]);
+
+	if (frames_free() != frames) result = FAIL;
+
+	return result;
+}
 
 /* Test suite entry point */
 void launch_tests(){
@@ -585,4 +1125,15 @@ void launch_tests(){
 	// TEST_OUTPUT("syscall_write_test", syscall_write_test());
 	// TEST_OUTPUT("syscall_close_test", syscall_close_test());
 	// // printf("sanity check\n");
+
+	// TEST_OUTPUT("tlb_benchmark", tlb_benchmark());
+	// TEST_OUTPUT("dentry_lookup_benchmark", dentry_lookup_benchmark());
+	// TEST_OUTPUT("fs_append_benchmark", fs_append_benchmark());
+	// TEST_OUTPUT("block_map_test", block_map_test());
+	// TEST_OUTPUT("pcache_readahead_test", pcache_readahead_test());
+	// TEST_OUTPUT("kmalloc_test", kmalloc_test());
+	// TEST_OUTPUT("shm_test", shm_test());
+	// TEST_OUTPUT("pipe_test", pipe_test());
+	// TEST_OUTPUT("splice_remap_test", splice_remap_test());
+	// TEST_OUTPUT("cow_fork_test", cow_fork_test());
 }
@@ -17,6 +17,15 @@
 #define ENTRY_SIZE 64       //size of each direc entry
 #define BLOCK_SIZE 4096     //4 KB
 #define MAX_NAME_LENGTH 32  //max Byte length
+#define MAX_DENTRIES 63     //dentries that fit in the boot block
+#define DENTRY_HASH_SIZE 128 //name index slots, power of 2 above 2 * MAX_DENTRIES
+#define EXTENT_CACHE_SIZE 16 //inodes whose last extent is cached
+#define MAX_FILE_BLOCKS (BLOCK_SIZE / 4 - 1) //data blocks an inode can list
+#define FS_MAX_BLOCKS 4096  //data blocks the writable filesystem can track (16MB)
+#define FS_MAX_INODES 1024  //inodes that can be flagged compressed
+
+// Dentry flags
+#define DENTRY_COMPRESSED 0x1   //file data is LZ compressed, see read_compressed
 
 // File Types
 #define RTC_ACCESS 0
@@ -36,10 +45,35 @@
 #define SYS_VIDMAP 8
 #define SYS_SET_HANDLER 9
 #define SYS_SIGRETURN 10
+#define SYS_SET_PRIORITY 11
+#define SYS_FORK 12
+#define SYS_SPAWN 13
+#define SYS_WAIT 14
+#define SYS_MMAP 15
+#define SYS_CREATE 16
+#define SYS_FLUSH 17
+#define SYS_GETDENTS 18
+#define SYS_PREAD 19
+#define SYS_PWRITE 20
+#define SYS_SBRK 21
+#define SYS_SHMGET 22
+#define SYS_SHMAT 23
+#define SYS_PIPE 24
+#define SYS_DUP2 25
+#define SYS_ISATTY 26
+#define SYS_VMSPLICE 27
 
 #define FLAG_FREE 0
 #define FLAG_BUSY 1
 
+// Process states (see scheduler.c)
+#define PROC_FREE    0  // PCB slot not in use
+#define PROC_READY   1  // waiting in the run queue
+#define PROC_RUNNING 2  // currently on the CPU
+#define PROC_WAITING 3  // parent blocked in execute until child halts
+#define PROC_SLEEPING 4 // blocked on a wait queue
+#define PROC_ZOMBIE  5  // halted async child, parent hasn't collected its status
+
 #define BASE_ADDR 0x800000
 #define PROG_OFFSET 0x400000
 
@@ -57,6 +91,12 @@
 #define MAX_CMD_LENGTH 10
 #define MAX_ARGUMENT_NUM 1
 
+// ELF header fields used by the loader
+#define ELF_PHOFF       28      // offset of program header table
+#define ELF_PHENTSIZE   42      // size of one program header
+#define ELF_PHNUM       44      // number of program headers
+#define ELF_PT_LOAD     1       // loadable segment
+
 /* ------- Keyboard/Terminal Constants ----------- */
 #define SCREEN_COLS 80
 #define MAX_BUF_SIZE 128
@@ -71,13 +111,18 @@
 #define PAGE_4MB            0x400000            //temp address for 4mb page
 #define SIZE          0x80                //set bit 7 to 1, indicates 4MB enabled
 #define ENABLE_PG           0x80000001          //set bit 31 to 1, enables paging
+#define CR4_PGE             0x80                //set bit 7 of cr4, enables global pages
 #define USER_MEM            0x8000000
 #define USER_PAGE           32
 #define VIDEO_START 0x08000000
 #define VIDEO_END   0x08400000
+#define USER_STACK_TOP      0x8400000           //user esp starts here (end of the 4MB user region)
+#define USER_STACK_MAX      0x100000            //user stack may grow down this far (1MB)
+#define USER_MMAP_TOP       (USER_STACK_TOP - USER_STACK_MAX)   //mmap'd files go down from here
 #define READ_WRITE  0x2
 #define USER    0x4
 #define PRESENT 0x1
+#define GLOBAL  0x100       //kept in the TLB across cr3 reloads (CR4.PGE)
 
 /* ------------------ RTC ------------- */
 
@@ -123,7 +168,8 @@ typedef struct dentry_struct{
     int8_t filename[MAX_NAME_LENGTH];
     uint32_t filetype;
     uint32_t inode_num;
-    uint8_t reserved[24];       //24B reserved for dentry, as defined in the boot block structure 
+    uint8_t flags;              //DENTRY_* flags, set by the image builder
+    uint8_t reserved[23];       //23B reserved for dentry, as defined in the boot block structure 
 }dentry_t;
 
 typedef struct boot_block_struct {
@@ -133,18 +179,36 @@ typedef struct boot_block_struct {
     uint8_t reserved[52];       //52B reserved for boot block, as defined in the boot block structure
     /*above represents the boot sub-block, 64B*/
     /*below represents the 63 other 64B sub-blocks that make up a single data block*/
-    dentry_t d[63];
+    dentry_t d[MAX_DENTRIES];
 }boot_block_t;
 
 typedef struct inode_struct{
     uint32_t data_length;
-    uint32_t data_block[BLOCK_SIZE / 4 - 1]; // each data block is 4B
+    uint32_t data_block[MAX_FILE_BLOCKS]; // each data block is 4B
 }inode_t;
 
 typedef struct datablock_struct{
     uint8_t data[BLOCK_SIZE];
 } datablock_t;
 
+// getdents record -- the name follows (not terminated), padded so the
+// next record starts on a 4 byte boundary
+typedef struct dirent_struct{
+    uint16_t record_length;     // bytes to the next record
+    uint8_t filetype;
+    uint8_t name_length;
+    uint32_t inode_num;
+    uint32_t size;              // file size, 0 for rtc and directories
+} dirent_t;
+
+// run of consecutive data blocks backing consecutive blocks of a file
+typedef struct extent_struct{
+    uint32_t inode;
+    uint32_t block;     // first block index in the file
+    uint32_t start;     // its data block number
+    uint32_t length;    // blocks in the run, 0 if unused
+} extent_t;
+
 
 
 /*--------- Syscall Structures -------------- */
@@ -165,6 +229,12 @@ typedef struct PCB_entry_struct
     uint32_t flags;
 } PCB_entry_t;
 
+/* Processes sleeping until some event (see sleep_on/wake_up) */
+typedef struct wait_queue {
+    struct PCB_struct* head;
+    struct PCB_struct* tail;
+} wait_queue_t;
+
 // PCB structure
 typedef struct PCB_struct
 {
@@ -180,13 +250,40 @@ typedef struct PCB_struct
     uint32_t user_ebp;
 
     uint32_t tss_esp0;
+    uint32_t entry;             // user program entry point
+
+    uint32_t kernel_stack;      // top of this process' kernel stack (PCB sits at the bottom)
+    uint32_t page_table;        // physical address of the page table for the 128MB user region
+
+    // program image, paged in from the filesystem on first touch
+    uint32_t image_inode;
+    uint32_t image_length;      // file size -- image pages past this are zero
+    uint32_t image_end;         // end of image in user memory (includes .bss)
+    uint32_t mmap_base;         // lowest address mapped by mmap, next file goes below it
+    uint32_t heap_start;        // first page after the image, the heap grows up from here
+    uint32_t brk;               // end of the heap (sbrk)
 
     int8_t argv[MAX_ARGUMENT_NUM][MAX_ARGS];
     int8_t cmd[10];
     uint32_t num_args;
 
     uint8_t is_shell;
-    uint8_t scheduled;
+    uint8_t async;              // parent isn't blocked in execute on it (fork/spawn)
+    int32_t exit_status;        // halt status of a zombie
+
+    // scheduler bookkeeping
+    uint32_t state;             // PROC_* state
+    int32_t terminal;           // terminal this process belongs to
+    struct PCB_struct* next;    // link in run queue or wait queue
+    uint32_t priority;          // current MLFQ level, 0 is highest
+    uint32_t base_priority;     // highest level the process may be boosted to
+    uint32_t ticks_left;        // PIT ticks left in current quantum
+    wait_queue_t child_wait;    // sleeping in wait until an async child halts
+
+    // async children (fork/spawn) not freed yet, linked through siblings
+    struct PCB_struct* children;
+    struct PCB_struct* next_sibling;
+    struct PCB_struct* prev_sibling;
 
 } PCB_t;
 
@@ -204,6 +301,8 @@ typedef struct terminal {
 volatile uint8_t    buffer[128]; // max buffer length of 128
 volatile int32_t    buffer_length;
 
+    wait_queue_t    read_wait; // processes waiting on enter
+
 } terminal_t;
 
 /* --------- Global Variables ----------- */
@@ -215,13 +314,10 @@ fop_t dir_fop;// = {dir_open, dir_close, dir_read, dir_write};
 fop_t filesys_fop;// = {dir_open, dir_close, dir_read, dir_write};
 fop_t rtc_fop;// = {rtc_open, rtc_close, rtc_read, rtc_write};
 
-PCB_t *curr_pcb;
+PCB_t *curr_pcb;   /* The process currently on the CPU. */
 uint32_t cur_pid;
 uint32_t parent_pid;
-// process at pid
-int process_flag[6];
 uint8_t global_status;
-uint8_t num_programs;
 
 terminal_t  terminals[3];     /* array of all terminals */
 int32_t     disp_terminal;           /* The terminal the user sees. */
@@ -5,8 +5,9 @@
 
 int main ()
 {
-    int32_t fd, cnt;
+    int32_t fd, cnt, rval;
     uint8_t buf[1024];
+    uint8_t* file;
 
     if (0 != ece391_getargs (buf, 1024)) {
         ece391_fdputs (1, (uint8_t*)"could not read arguments\n");
@@ -18,6 +19,18 @@ int main ()
 	return 2;
     }
 
+    /* write the file straight out of a mapping, no copy -- into a pipe
+       its pages are spliced rather than copied into the pipe's buffer */
+    if (-1 != (cnt = ece391_mmap (fd, &file))) {
+        if (0 == ece391_isatty (1))
+	    rval = ece391_vmsplice (1, file, cnt);
+	else
+	    rval = ece391_write (1, file, cnt);
+        if (0 != cnt && -1 == rval)
+	    return 3;
+	return 0;
+    }
+
     while (0 != (cnt = ece391_read (fd, buf, 1024))) {
         if (-1 == cnt) {
 	    ece391_fdputs (1, (uint8_t*)"file read failed\n");
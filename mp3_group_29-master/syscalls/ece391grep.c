@@ -6,91 +6,161 @@
 #define BUFSIZE 1024
 #define SBUFSIZE 33
 
+/* whether a '\0' terminated line of len characters contains s */
 int32_t
-do_one_file (const char* s, const char* fname) 
+line_matches (const char* s, int32_t s_len, uint8_t* line, int32_t len)
 {
-    int32_t fd, cnt, last, line_start, line_end, check, s_len;
-    uint8_t data[BUFSIZE+1];
+    int32_t check;
+
+    for (check = 0; check < len; check++) {
+	if (s[0] == line[check] && 
+	    0 == ece391_strncmp (line + check, (uint8_t*)s, s_len))
+	    return 1;
+    }
+    return 0;
+}
+
+int32_t
+do_one_file (const char* s, const char* fname, uint32_t size) 
+{
+    int32_t fd, cnt, line_start, line_end, s_len;
+    uint32_t last, cap;
+    uint8_t* data;
+    uint8_t* more;
 
     s_len = ece391_strlen ((uint8_t*)s);
     if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
         ece391_fdputs (1, (uint8_t*)"file open failed\n");
         return -1;
     }
+    /* read the whole file, so lines of any length can be searched --
+       the directory gave its size, but it may have grown since */
+    cap = (size < BUFSIZE) ? BUFSIZE : size + 1;
+    if (0 == (data = ece391_malloc (cap))) {
+        ece391_fdputs (1, (uint8_t*)"out of memory\n");
+        return -1;
+    }
     last = 0;
-    while (1) {
-        cnt = ece391_read (fd, data + last, BUFSIZE - last);
+    while (0 != (cnt = ece391_read (fd, data + last, cap - 1 - last))) {
 	if (-1 == cnt) {
             ece391_fdputs (1, (uint8_t*)"file read failed\n");
+            ece391_free (data);
             return -1;
 	}
 	last += cnt;
-	line_start = 0;
-	while (1) {
+	if (cap - 1 == last) {
+	    if (0 == (more = ece391_realloc (data, cap * 2))) {
+		ece391_fdputs (1, (uint8_t*)"out of memory\n");
+		ece391_free (data);
+		return -1;
+	    }
+	    data = more;
+	    cap *= 2;
+	}
+    }
+    for (line_start = 0; line_start < last; line_start = line_end + 1) {
+	line_end = line_start;
+	while (line_end < last && '\n' != data[line_end])
+	    line_end++;
+	data[line_end] = '\0';
+	if (line_matches (s, s_len, data + line_start, line_end - line_start)) {
+	    ece391_fdputs (1, (uint8_t*)fname);
+	    ece391_fdputs (1, (uint8_t*)":");
+	    ece391_fdputs (1, data + line_start);
+	    ece391_fdputs (1, (uint8_t*)"\n");
+	}
+    }
+    ece391_free (data);
+    if (-1 == ece391_close (fd)) {
+        ece391_fdputs (1, (uint8_t*)"file close failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Searches stdin (e.g. a pipe) a line at a time, printing matches as
+   they come in rather than after the writer is done. A line longer than
+   the buffer is searched in BUFSIZE - 1 pieces. */
+int32_t
+do_stdin (const char* s)
+{
+    uint8_t data[BUFSIZE];
+    int32_t cnt, last, line_start, line_end, s_len;
+
+    s_len = ece391_strlen ((uint8_t*)s);
+    last = 0;
+    do {
+	if (-1 == (cnt = ece391_read (0, data + last, BUFSIZE - 1 - last))) {
+	    ece391_fdputs (1, (uint8_t*)"read failed\n");
+	    return -1;
+	}
+	last += cnt;
+	for (line_start = 0; ; line_start = line_end + 1) {
 	    line_end = line_start;
 	    while (line_end < last && '\n' != data[line_end])
 		line_end++;
-	    if ('\n' != data[line_end] && 0 != cnt && line_start != 0) {
-		/* copy from line_start to last down to 0 and fix last */
-		data[line_end] = '\0';
-		ece391_strcpy (data, data + line_start);
-		last -= line_start;
+	    /* keep an unfinished line for the next read, unless it fills
+	       the buffer or nothing more is coming */
+	    if (line_end == last && 0 != cnt &&
+		(0 != line_start || BUFSIZE - 1 != last))
+		break;
+	    if (line_end == last && line_start == last)
 		break;
-	    }
-	    /* search the line */
 	    data[line_end] = '\0';
-	    for (check = line_start; check < line_end; check++) {
-		if (s[0] == data[check] && 
-		    0 == ece391_strncmp ((uint8_t*)(data + check), (uint8_t*)s, s_len)) {
-		    ece391_fdputs (1, (uint8_t*)fname);
-		    ece391_fdputs (1, (uint8_t*)":");
-		    ece391_fdputs (1, data + line_start);
-		    ece391_fdputs (1, (uint8_t*)"\n");
-		    break;
-		}
+	    if (line_matches (s, s_len, data + line_start, line_end - line_start)) {
+		ece391_fdputs (1, data + line_start);
+		ece391_fdputs (1, (uint8_t*)"\n");
 	    }
-	    line_start = line_end + 1;
-	    if (line_start >= last) {
-	        last = 0;
+	    if (line_end == last) {
+		line_start = last;
 		break;
 	    }
 	}
-	if (0 == cnt)
-	    break;
-    }
-    if (-1 == ece391_close (fd)) {
-        ece391_fdputs (1, (uint8_t*)"file close failed\n");
-        return -1;
-    }
+	/* move the unfinished line to the front */
+	for (line_end = 0; line_start + line_end < last; line_end++)
+	    data[line_end] = data[line_start + line_end];
+	last = line_end;
+    } while (0 != cnt);
     return 0;
 }
 
 int main ()
 {
-    int32_t fd, cnt;
+    int32_t fd, cnt, pos, i;
     uint8_t buf[SBUFSIZE];
     uint8_t search[BUFSIZE];
+    uint8_t dents[BUFSIZE * 4];
+    ece391_dirent_t* ent;
 
     if (0 != ece391_getargs (search, BUFSIZE)) {
         ece391_fdputs (1, (uint8_t*)"could not read argument\n");
         return 3;
     }
 
+    /* "cmd | grep s" searches cmd's output instead of the files */
+    if (0 == ece391_isatty (0))
+        return (0 != do_stdin ((char*)search)) ? 3 : 0;
+
     if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
         ece391_fdputs (1, (uint8_t*)"directory open failed\n");
 	return 2;
     }
 
-    while (0 != (cnt = ece391_read (fd, buf, SBUFSIZE-1))) {
+    while (0 != (cnt = ece391_getdents (fd, dents, BUFSIZE * 4))) {
         if (-1 == cnt) {
 	    ece391_fdputs (1, (uint8_t*)"directory entry read failed\n");
 	    return 3;
 	}
-	if ('.' == buf[0]) /* a directory... */
-	    continue;
-	buf[cnt] = '\0';
-	if (0 != do_one_file ((char*)search, (char*)buf))
-	    return 3;
+	for (pos = 0; pos < cnt; pos += ent->reclen) {
+	    ent = (ece391_dirent_t*)(dents + pos);
+	    if (2 != ent->type) /* only regular files */
+		continue;
+	    for (i = 0; i < ent->namelen; i++)
+		buf[i] = ((uint8_t*)(ent + 1))[i];
+	    buf[i] = '\0';
+	    if (0 != do_one_file ((char*)search, (char*)buf, ent->size))
+		return 3;
+	}
     }
 
     return 0;
@@ -3,27 +3,43 @@
 #include "ece391support.h"
 #include "ece391syscall.h"
 
-#define SBUFSIZE 33
+#define DBUFSIZE 4096
+#define OBUFSIZE 2200   /* 63 names of up to 32 chars, plus newlines */
 
 int main ()
 {
-    int32_t fd, cnt;
-    uint8_t buf[SBUFSIZE];
+    int32_t fd, cnt, pos, out, i;
+    uint8_t buf[DBUFSIZE];
+    uint8_t obuf[OBUFSIZE];
+    ece391_dirent_t* ent;
 
     if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
         ece391_fdputs (1, (uint8_t*)"directory open failed\n");
         return 2;
     }
 
-    while (0 != (cnt = ece391_read (fd, buf, SBUFSIZE-1))) {
+    /* usually the whole directory comes back in one call */
+    out = 0;
+    while (0 != (cnt = ece391_getdents (fd, buf, DBUFSIZE))) {
         if (-1 == cnt) {
 	        ece391_fdputs (1, (uint8_t*)"directory entry read failed\n");
 	        return 3;
 	    }
-	    buf[cnt] = '\n';
-	    if (-1 == ece391_write (1, buf, cnt + 1))
-	        return 3;
+	    for (pos = 0; pos < cnt; pos += ent->reclen) {
+	        ent = (ece391_dirent_t*)(buf + pos);
+	        if (out + ent->namelen + 1 > OBUFSIZE) {
+	            if (-1 == ece391_write (1, obuf, out))
+	                return 3;
+	            out = 0;
+	        }
+	        for (i = 0; i < ent->namelen; i++)
+	            obuf[out++] = ((uint8_t*)(ent + 1))[i];
+	        obuf[out++] = '\n';
+	    }
     }
 
+    if (0 != out && -1 == ece391_write (1, obuf, out))
+        return 3;
+
     return 0;
 }
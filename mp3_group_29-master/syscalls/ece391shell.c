@@ -4,11 +4,99 @@
 #include "ece391syscall.h"
 
 #define BUFSIZE 1024
+#define MAX_JOBS 16
+#define MAX_STAGES 8
+#define SAVED_STDIN 6	/* the terminal, while fds 0 and 1 are pipes */
+#define SAVED_STDOUT 7
+
+/* Starts each command of "cmd | cmd | ...", stdout of one connected to
+   stdin of the next by a pipe. Returns how many were started, pids of
+   those in pids, or -1 if the line is malformed. */
+int32_t
+run_pipeline (uint8_t* buf, int32_t* pids)
+{
+    uint8_t* stage[MAX_STAGES];
+    int32_t nstages, started, i, in, rval, failed;
+    int32_t fds[2];
+    uint8_t* s;
+    uint8_t* end;
+
+    nstages = 0;
+    stage[nstages++] = buf;
+    for (s = buf; '\0' != *s; s++) {
+	if ('|' != *s)
+	    continue;
+	if (MAX_STAGES == nstages) {
+	    ece391_fdputs (1, (uint8_t*)"too many commands in pipeline\n");
+	    return -1;
+	}
+	*s = '\0';
+	stage[nstages++] = s + 1;
+    }
+    for (i = 0; i < nstages; i++) {
+	while (' ' == *stage[i])
+	    stage[i]++;
+	end = stage[i] + ece391_strlen (stage[i]);
+	while (end > stage[i] && ' ' == end[-1])
+	    *--end = '\0';
+	if ('\0' == *stage[i]) {
+	    ece391_fdputs (1, (uint8_t*)"missing command in pipeline\n");
+	    return -1;
+	}
+    }
+
+    if (-1 == ece391_dup2 (0, SAVED_STDIN) || -1 == ece391_dup2 (1, SAVED_STDOUT)) {
+	ece391_fdputs (1, (uint8_t*)"could not save terminal\n");
+	return -1;
+    }
+
+    /* programs get the shell's fds 0 and 1, so point those at the pipes
+       around each one in turn -- the shell keeps no write end open, so
+       each reader sees the end of its input when its writer halts */
+    started = 0;
+    failed = 0;
+    in = -1;
+    for (i = 0; i < nstages; i++) {
+	fds[0] = fds[1] = -1;
+	if (i < nstages - 1 && -1 == ece391_pipe (fds)) {
+	    failed = 1;
+	    break;
+	}
+	ece391_dup2 ((-1 == in) ? SAVED_STDIN : in, 0);
+	ece391_dup2 ((-1 == fds[1]) ? SAVED_STDOUT : fds[1], 1);
+	if (-1 == (rval = ece391_spawn (stage[i])))
+	    failed = 1;
+	else
+	    pids[started++] = rval;
+	if (-1 != in)
+	    ece391_close (in);
+	if (-1 != fds[1])
+	    ece391_close (fds[1]);
+	in = fds[0];
+    }
+    if (-1 != in)
+	ece391_close (in);
+
+    ece391_dup2 (SAVED_STDIN, 0);
+    ece391_dup2 (SAVED_STDOUT, 1);
+    ece391_close (SAVED_STDIN);
+    ece391_close (SAVED_STDOUT);
+
+    if (failed)
+	ece391_fdputs (1, (uint8_t*)"pipeline failed to start\n");
+    return started;
+}
 
 int main ()
 {
     int32_t cnt, rval;
     uint8_t buf[BUFSIZE];
+    uint8_t num[12];
+    int32_t jobs[MAX_JOBS];	/* background jobs not waited for yet */
+    int32_t njobs = 0;
+    int32_t background;
+    int32_t pids[MAX_STAGES];
+    int32_t npids, i;
     ece391_fdputs (1, (uint8_t*)"Starting 391 Shell\n");
 
     while (1) {
@@ -20,10 +108,61 @@ int main ()
 	if (cnt > 0 && '\n' == buf[cnt - 1])
 	    cnt--;
 	buf[cnt] = '\0';
+	/* "cmd &" runs cmd in the background */
+	background = 0;
+	while (cnt > 0 && ' ' == buf[cnt - 1])
+	    buf[--cnt] = '\0';
+	if (cnt > 0 && '&' == buf[cnt - 1]) {
+	    background = 1;
+	    buf[--cnt] = '\0';
+	    while (cnt > 0 && ' ' == buf[cnt - 1])
+		buf[--cnt] = '\0';
+	}
 	if (0 == ece391_strcmp (buf, (uint8_t*)"exit"))
 	    return 0;
 	if ('\0' == buf[0])
 	    continue;
+	if (0 == ece391_strcmp (buf, (uint8_t*)"wait")) {
+	    while (njobs > 0)
+		ece391_wait (jobs[--njobs]);
+	    continue;
+	}
+	for (i = 0; '\0' != buf[i] && '|' != buf[i]; i++)
+	    ;
+	if ('|' == buf[i]) {
+	    if (background && MAX_JOBS - njobs < MAX_STAGES) {
+		ece391_fdputs (1, (uint8_t*)"too many background jobs, try wait\n");
+		continue;
+	    }
+	    if (-1 == (npids = run_pipeline (buf, pids)))
+		continue;
+	    for (i = 0; i < npids; i++) {
+		if (!background) {
+		    ece391_wait (pids[i]);
+		    continue;
+		}
+		jobs[njobs++] = pids[i];
+		ece391_fdputs (1, (uint8_t*)"[");
+		ece391_fdputs (1, ece391_itoa (pids[i], num, 10));
+		ece391_fdputs (1, (uint8_t*)"]\n");
+	    }
+	    continue;
+	}
+	if (background) {
+	    if (MAX_JOBS == njobs) {
+		ece391_fdputs (1, (uint8_t*)"too many background jobs, try wait\n");
+		continue;
+	    }
+	    if (-1 == (rval = ece391_spawn (buf))) {
+		ece391_fdputs (1, (uint8_t*)"no such command\n");
+		continue;
+	    }
+	    jobs[njobs++] = rval;
+	    ece391_fdputs (1, (uint8_t*)"[");
+	    ece391_fdputs (1, ece391_itoa (rval, num, 10));
+	    ece391_fdputs (1, (uint8_t*)"]\n");
+	    continue;
+	}
 	rval = ece391_execute (buf);
 	if (-1 == rval)
 	    ece391_fdputs (1, (uint8_t*)"no such command\n");
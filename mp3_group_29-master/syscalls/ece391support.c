@@ -102,3 +102,112 @@ uint8_t* ece391_strrev(uint8_t* s)
    return s;
 }
 
+
+/* Heap allocator on top of ece391_sbrk.  Every block starts with a
+ * header holding its size (header included, a multiple of 8 bytes).
+ * Free blocks are kept in address order so that neighbours merge when
+ * freed; allocation is first fit, splitting off the end of the block. */
+typedef struct heap_block {
+    struct heap_block* next;    /* next free block (free blocks only) */
+    uint32_t size;
+} heap_block_t;
+
+#define HEAP_ALIGN 8
+#define HEAP_GROW  4096         /* least the heap grows by at a time */
+
+static heap_block_t* heap_free;
+
+/* Get at least size more bytes of heap from the kernel */
+static int32_t heap_grow(uint32_t size)
+{
+    heap_block_t* b;
+
+    size = (size + HEAP_GROW - 1) & ~(HEAP_GROW - 1);
+    b = ece391_sbrk(size);
+    if ((void*)-1 == b)
+        return -1;
+
+    b->size = size;
+    ece391_free(b + 1);
+    return 0;
+}
+
+void* ece391_malloc(uint32_t size)
+{
+    heap_block_t** prev;
+    heap_block_t* b;
+    uint32_t need;
+
+    if (0 == size || size > 0x7FFFF000)
+        return 0;
+    need = (size + sizeof(heap_block_t) + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1);
+
+    while (1) {
+        for (prev = &heap_free; 0 != (b = *prev); prev = &b->next) {
+            if (b->size < need)
+                continue;
+            if (b->size - need >= 2 * sizeof(heap_block_t)) {
+                /* hand out the end, the rest stays on the list */
+                b->size -= need;
+                b = (heap_block_t*)((uint8_t*)b + b->size);
+                b->size = need;
+            } else {
+                *prev = b->next;
+            }
+            return b + 1;
+        }
+        if (0 != heap_grow(need))
+            return 0;
+    }
+}
+
+void ece391_free(void* ptr)
+{
+    heap_block_t* b;
+    heap_block_t* p;
+
+    if (0 == ptr)
+        return;
+    b = (heap_block_t*)ptr - 1;
+
+    /* p is the last free block before b, if any */
+    if (0 == heap_free || b < heap_free) {
+        b->next = heap_free;
+        heap_free = b;
+        p = 0;
+    } else {
+        for (p = heap_free; 0 != p->next && p->next < b; p = p->next);
+        b->next = p->next;
+        p->next = b;
+    }
+
+    if (0 != b->next && (uint8_t*)b + b->size == (uint8_t*)b->next) {
+        b->size += b->next->size;
+        b->next = b->next->next;
+    }
+    if (0 != p && (uint8_t*)p + p->size == (uint8_t*)b) {
+        p->size += b->size;
+        p->next = b->next;
+    }
+}
+
+void* ece391_realloc(void* ptr, uint32_t size)
+{
+    heap_block_t* b;
+    uint8_t* n;
+    uint32_t i, old;
+
+    if (0 == ptr)
+        return ece391_malloc(size);
+    b = (heap_block_t*)ptr - 1;
+    old = b->size - sizeof(heap_block_t);
+    if (size <= old)
+        return ptr;
+
+    if (0 == (n = ece391_malloc(size)))
+        return 0;
+    for (i = 0; i < old; i++)
+        n[i] = ((uint8_t*)ptr)[i];
+    ece391_free(ptr);
+    return n;
+}
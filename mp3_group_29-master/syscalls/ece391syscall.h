@@ -21,6 +21,36 @@ extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
+extern int32_t ece391_set_priority (int32_t priority);
+extern int32_t ece391_fork (void);
+extern int32_t ece391_spawn (const uint8_t* command);
+extern int32_t ece391_wait (int32_t pid);
+extern int32_t ece391_mmap (int32_t fd, uint8_t** start);
+extern int32_t ece391_create (const uint8_t* filename);
+extern int32_t ece391_flush (void);
+extern int32_t ece391_getdents (int32_t fd, void* buf, int32_t nbytes);
+extern int32_t ece391_pread (int32_t fd, void* buf, int32_t nbytes, uint32_t offset);
+extern int32_t ece391_pwrite (int32_t fd, const void* buf, int32_t nbytes, uint32_t offset);
+extern void* ece391_sbrk (int32_t increment);
+extern int32_t ece391_shmget (uint32_t key, uint32_t size);
+extern void* ece391_shmat (int32_t id, void* addr);
+extern int32_t ece391_pipe (int32_t* fds);
+extern int32_t ece391_dup2 (int32_t oldfd, int32_t newfd);
+extern int32_t ece391_isatty (int32_t fd);
+extern int32_t ece391_vmsplice (int32_t fd, void* buf, int32_t nbytes);
+
+/* 
+ * Records filled in by ece391_getdents, back to back. Each header is
+ * followed by the name (not NUL-terminated); reclen is the distance to
+ * the next record.
+ */
+typedef struct ece391_dirent {
+    uint16_t reclen;
+    uint8_t type;
+    uint8_t namelen;
+    uint32_t inode;
+    uint32_t size;
+} ece391_dirent_t;
 
 enum signums {
 	DIV_ZERO = 0,
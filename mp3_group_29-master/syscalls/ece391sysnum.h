@@ -11,5 +11,22 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_SET_PRIORITY  11
+#define SYS_FORK          12
+#define SYS_SPAWN         13
+#define SYS_WAIT          14
+#define SYS_MMAP          15
+#define SYS_CREATE        16
+#define SYS_FLUSH         17
+#define SYS_GETDENTS      18
+#define SYS_PREAD         19
+#define SYS_PWRITE        20
+#define SYS_SBRK          21
+#define SYS_SHMGET        22
+#define SYS_SHMAT         23
+#define SYS_PIPE          24
+#define SYS_DUP2          25
+#define SYS_ISATTY        26
+#define SYS_VMSPLICE      27
 
 #endif /* ECE391SYSNUM_H */